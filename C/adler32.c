@@ -0,0 +1,257 @@
+/*
+ * Created..: 16 October 2026
+ * Filename.: adler32.c
+ * Purpose..: Vectorized Adler-32 for local_adler32.
+ *
+ * The kext_tools loop adds one byte at a time and reduces modulo 65521 every
+ * 5000 bytes. The reduction can be postponed for up to ADLER32_NMAX bytes
+ * without overflowing 32 bits, which gives the same result and leaves room
+ * to sum 16/32 bytes per step:
+ *
+ *   s1' = s1 + sum(b[i])
+ *   s2' = s2 + n * s1 + sum((n - i) * b[i])      (i = 0 .. n-1)
+ *
+ * psadbw adds the bytes for s1, pmaddubsw/pmaddwd multiply them with the
+ * weights n..1 for s2. The kernel is picked once from CPUID.
+ */
+
+#include "adler32.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define ADLER32_X86		1
+#else
+#define ADLER32_X86		0
+#endif
+
+#define ADLER32_BASE	65521
+#define ADLER32_NMAX	5552		// largest n with 255n(n+1)/2 + (n+1)(BASE-1) < 2^32
+#define ADLER32_BLOCK	32
+
+//==============================================================================
+
+uint32_t lzvn_adler32_scalar(uint32_t aAdler32, const uint8_t * aBuffer, size_t aLength)
+{
+	uint32_t	s1 = aAdler32 & 0xffff;
+	uint32_t	s2 = aAdler32 >> 16;
+	size_t		n;
+
+	while (aLength > 0)
+	{
+		n = (aLength < ADLER32_NMAX) ? aLength : ADLER32_NMAX;
+		aLength -= n;
+
+		while (n >= 8)
+		{
+			s1 += aBuffer[0]; s2 += s1;
+			s1 += aBuffer[1]; s2 += s1;
+			s1 += aBuffer[2]; s2 += s1;
+			s1 += aBuffer[3]; s2 += s1;
+			s1 += aBuffer[4]; s2 += s1;
+			s1 += aBuffer[5]; s2 += s1;
+			s1 += aBuffer[6]; s2 += s1;
+			s1 += aBuffer[7]; s2 += s1;
+			aBuffer += 8;
+			n -= 8;
+		}
+
+		while (n--)
+		{
+			s1 += *aBuffer++;
+			s2 += s1;
+		}
+
+		s1 %= ADLER32_BASE;
+		s2 %= ADLER32_BASE;
+	}
+
+	return (s2 << 16) | s1;
+}
+
+#if ADLER32_X86
+
+//==============================================================================
+
+__attribute__((target("ssse3")))
+static inline uint32_t adler32_hsum_epi32(__m128i v)
+{
+	v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+	v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+
+	return (uint32_t)_mm_cvtsi128_si32(v);
+}
+
+//==============================================================================
+
+__attribute__((target("ssse3")))
+uint32_t lzvn_adler32_ssse3(uint32_t aAdler32, const uint8_t * aBuffer, size_t aLength)
+{
+	const __m128i	tap1	= _mm_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17);
+	const __m128i	tap2	= _mm_setr_epi8(16, 15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2,  1);
+	const __m128i	ones	= _mm_set1_epi16(1);
+	const __m128i	zero	= _mm_setzero_si128();
+	uint32_t		s1		= aAdler32 & 0xffff;
+	uint32_t		s2		= aAdler32 >> 16;
+
+	while (aLength >= ADLER32_BLOCK)
+	{
+		size_t	blocks	= aLength / ADLER32_BLOCK;
+		__m128i	v_ps	= zero;		// sum of s1 at the start of each block
+		__m128i	v_s1	= zero;
+		__m128i	v_s2	= zero;
+
+		if (blocks > (ADLER32_NMAX / ADLER32_BLOCK))
+		{
+			blocks = ADLER32_NMAX / ADLER32_BLOCK;
+		}
+
+		aLength -= blocks * ADLER32_BLOCK;
+		s2 += s1 * (uint32_t)(blocks * ADLER32_BLOCK);
+
+		while (blocks--)
+		{
+			const __m128i bytes1 = _mm_loadu_si128((const __m128i *)aBuffer);
+			const __m128i bytes2 = _mm_loadu_si128((const __m128i *)(aBuffer + 16));
+
+			v_ps = _mm_add_epi32(v_ps, v_s1);
+			v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(bytes1, zero));
+			v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(bytes2, zero));
+			v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(_mm_maddubs_epi16(bytes1, tap1), ones));
+			v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(_mm_maddubs_epi16(bytes2, tap2), ones));
+
+			aBuffer += ADLER32_BLOCK;
+		}
+
+		v_s2 = _mm_add_epi32(v_s2, _mm_slli_epi32(v_ps, 5));
+
+		s1 += adler32_hsum_epi32(v_s1);
+		s2 += adler32_hsum_epi32(v_s2);
+
+		s1 %= ADLER32_BASE;
+		s2 %= ADLER32_BASE;
+	}
+
+	return lzvn_adler32_scalar((s2 << 16) | s1, aBuffer, aLength);
+}
+
+//==============================================================================
+
+__attribute__((target("avx2")))
+uint32_t lzvn_adler32_avx2(uint32_t aAdler32, const uint8_t * aBuffer, size_t aLength)
+{
+	// Two 32-byte loads per step, so the v_ps chain is half as long as in SSSE3.
+	const __m256i	tap1	= _mm256_setr_epi8(64, 63, 62, 61, 60, 59, 58, 57, 56, 55, 54, 53, 52, 51, 50, 49,
+											   48, 47, 46, 45, 44, 43, 42, 41, 40, 39, 38, 37, 36, 35, 34, 33);
+	const __m256i	tap2	= _mm256_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17,
+											   16, 15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2,  1);
+	const __m256i	ones	= _mm256_set1_epi16(1);
+	const __m256i	zero	= _mm256_setzero_si256();
+	uint32_t		s1		= aAdler32 & 0xffff;
+	uint32_t		s2		= aAdler32 >> 16;
+
+	while (aLength >= (2 * ADLER32_BLOCK))
+	{
+		size_t	blocks	= aLength / (2 * ADLER32_BLOCK);
+		__m256i	v_ps	= zero;
+		__m256i	v_s1	= zero;
+		__m256i	v_s2	= zero;
+		__m128i	sum1, sum2;
+
+		if (blocks > (ADLER32_NMAX / (2 * ADLER32_BLOCK)))
+		{
+			blocks = ADLER32_NMAX / (2 * ADLER32_BLOCK);
+		}
+
+		aLength -= blocks * 2 * ADLER32_BLOCK;
+		s2 += s1 * (uint32_t)(blocks * 2 * ADLER32_BLOCK);
+
+		while (blocks--)
+		{
+			const __m256i bytes1 = _mm256_loadu_si256((const __m256i *)aBuffer);
+			const __m256i bytes2 = _mm256_loadu_si256((const __m256i *)(aBuffer + 32));
+
+			v_ps = _mm256_add_epi32(v_ps, v_s1);
+			v_s1 = _mm256_add_epi32(v_s1, _mm256_add_epi64(_mm256_sad_epu8(bytes1, zero), _mm256_sad_epu8(bytes2, zero)));
+			v_s2 = _mm256_add_epi32(v_s2, _mm256_madd_epi16(_mm256_maddubs_epi16(bytes1, tap1), ones));
+			v_s2 = _mm256_add_epi32(v_s2, _mm256_madd_epi16(_mm256_maddubs_epi16(bytes2, tap2), ones));
+
+			aBuffer += 2 * ADLER32_BLOCK;
+		}
+
+		v_s2 = _mm256_add_epi32(v_s2, _mm256_slli_epi32(v_ps, 6));
+
+		sum1 = _mm_add_epi32(_mm256_castsi256_si128(v_s1), _mm256_extracti128_si256(v_s1, 1));
+		sum2 = _mm_add_epi32(_mm256_castsi256_si128(v_s2), _mm256_extracti128_si256(v_s2, 1));
+
+		s1 += adler32_hsum_epi32(sum1);
+		s2 += adler32_hsum_epi32(sum2);
+
+		s1 %= ADLER32_BASE;
+		s2 %= ADLER32_BASE;
+	}
+
+	return lzvn_adler32_ssse3((s2 << 16) | s1, aBuffer, aLength);
+}
+
+#else
+
+uint32_t lzvn_adler32_ssse3(uint32_t aAdler32, const uint8_t * aBuffer, size_t aLength)
+{
+	return lzvn_adler32_scalar(aAdler32, aBuffer, aLength);
+}
+
+uint32_t lzvn_adler32_avx2(uint32_t aAdler32, const uint8_t * aBuffer, size_t aLength)
+{
+	return lzvn_adler32_scalar(aAdler32, aBuffer, aLength);
+}
+
+#endif /* ADLER32_X86 */
+
+//==============================================================================
+
+typedef uint32_t (*adler32_kernel)(uint32_t, const uint8_t *, size_t);
+
+static adler32_kernel	gAdler32Kernel		= NULL;
+static const char		*gAdler32KernelName	= "scalar";
+
+static void adler32_select(void)
+{
+	adler32_kernel kernel = lzvn_adler32_scalar;
+
+#if ADLER32_X86
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx2"))
+	{
+		kernel = lzvn_adler32_avx2;
+		gAdler32KernelName = "avx2";
+	}
+	else if (__builtin_cpu_supports("ssse3"))
+	{
+		kernel = lzvn_adler32_ssse3;
+		gAdler32KernelName = "ssse3";
+	}
+#endif
+
+	gAdler32Kernel = kernel;
+}
+
+uint32_t lzvn_adler32(uint32_t aAdler32, const uint8_t * aBuffer, size_t aLength)
+{
+	if (gAdler32Kernel == NULL)
+	{
+		adler32_select();
+	}
+
+	return gAdler32Kernel(aAdler32, aBuffer, aLength);
+}
+
+const char * lzvn_adler32_kernel(void)
+{
+	if (gAdler32Kernel == NULL)
+	{
+		adler32_select();
+	}
+
+	return gAdler32KernelName;
+}
@@ -0,0 +1,23 @@
+/*
+ * Created..: 16 October 2026
+ * Filename.: adler32.h
+ * Purpose..: Adler-32 kernels (scalar, SSSE3 and AVX2) used by local_adler32.
+ */
+
+#ifndef _LZVN_ADLER32_H_
+#define _LZVN_ADLER32_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Same value as local_adler32 in kext_tools (start with aAdler32 = 1).
+extern uint32_t lzvn_adler32(uint32_t aAdler32, const uint8_t * aBuffer, size_t aLength);
+
+extern uint32_t lzvn_adler32_scalar(uint32_t aAdler32, const uint8_t * aBuffer, size_t aLength);
+extern uint32_t lzvn_adler32_ssse3(uint32_t aAdler32, const uint8_t * aBuffer, size_t aLength);
+extern uint32_t lzvn_adler32_avx2(uint32_t aAdler32, const uint8_t * aBuffer, size_t aLength);
+
+// Name of the kernel lzvn_adler32 uses on this CPU.
+extern const char * lzvn_adler32_kernel(void);
+
+#endif /* _LZVN_ADLER32_H_ */
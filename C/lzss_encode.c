@@ -0,0 +1,245 @@
+/*
+ * Created..: 16 October 2026
+ * Filename.: lzss_encode.c
+ * Purpose..: LZSS encoder for 'lzss' prelinkedkernels.
+ *
+ * Writes the format read by decompress_lzss() in lzvn.h (and by the older
+ * boot loaders): a flag byte for every 8 items, bit set = one literal byte,
+ * bit clear = a two byte match:
+ *
+ *   PPPPPPPP PPPPLLLL        P = position in the 4096 byte ring buffer
+ *                            L = length - (THRESHOLD + 1), so 3..18 bytes
+ *
+ * The ring buffer starts at N - F, so input byte i is at ring position
+ * (N - F + i) & (N - 1). Matches are found with hash chains over the last
+ * N - F bytes (the distance the original encoder uses as well), and never
+ * reference the ' ' preset before the start of the input.
+ *
+ * Effort levels 1..9 set how many chain entries are checked per position,
+ * and whether a match may be deferred by one byte for a longer one (lazy).
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "../FastCompression.h"
+
+#define LZSS_N					4096		// size of ring buffer (N in lzvn.h)
+#define LZSS_F					18			// upper limit for match length (F)
+#define LZSS_THRESHOLD			2			// encode string into position and length (THRESHOLD)
+#define LZSS_MIN_MATCH			(LZSS_THRESHOLD + 1)
+#define LZSS_MAX_DISTANCE		(LZSS_N - LZSS_F)
+
+#define LZSS_HASH_BITS			15
+#define LZSS_HASH_SIZE			(1 << LZSS_HASH_BITS)
+
+typedef struct
+{
+	int32_t		chain;			// chain entries checked per position
+	int32_t		lazy;			// try the next position for a longer match
+} lzss_level;
+
+static const lzss_level lzss_levels[LZSS_MAX_LEVEL + 1] =
+{
+	{    0, 0 },
+	{    2, 0 },
+	{    4, 0 },
+	{    8, 0 },
+	{   16, 1 },
+	{   32, 1 },
+	{   64, 1 },
+	{  256, 1 },
+	{ 1024, 1 },
+	{ 4096, 1 }
+};
+
+typedef struct
+{
+	const uint8_t	*src;
+	int64_t			src_size;
+	int32_t			head[LZSS_HASH_SIZE];
+	int32_t			prev[LZSS_N];			// previous position with the same hash, by position & (N - 1)
+	int64_t			inserted;				// positions below this one are in the chains
+} lzss_encoder;
+
+//==============================================================================
+
+static inline uint32_t lzss_hash3(const uint8_t *p)
+{
+	uint32_t value = p[0] | (p[1] << 8) | (p[2] << 16);
+
+	return (value * 2654435761u) >> (32 - LZSS_HASH_BITS);
+}
+
+//==============================================================================
+// Add all positions below aPos to the hash chains.
+
+static inline void lzss_insert(lzss_encoder *state, int64_t aPos)
+{
+	int64_t last = state->src_size - LZSS_MIN_MATCH;
+
+	if (aPos > last + 1)
+	{
+		aPos = last + 1;
+	}
+
+	while (state->inserted < aPos)
+	{
+		uint32_t h = lzss_hash3(state->src + state->inserted);
+
+		state->prev[state->inserted & (LZSS_N - 1)] = state->head[h];
+		state->head[h] = (int32_t)state->inserted;
+		state->inserted++;
+	}
+}
+
+//==============================================================================
+// Longest match (>= LZSS_MIN_MATCH) for aPos, or 0. *aMatchPos is its start.
+
+static int64_t lzss_find_match(lzss_encoder *state, int64_t aPos, int32_t aChain, int64_t *aMatchPos)
+{
+	const uint8_t	*src		= state->src;
+	const uint8_t	*current	= src + aPos;
+	int64_t			maxLength	= state->src_size - aPos;
+	int64_t			bestLength	= LZSS_MIN_MATCH - 1;
+	int64_t			candidate;
+
+	if (maxLength < LZSS_MIN_MATCH)
+	{
+		return 0;
+	}
+
+	if (maxLength > LZSS_F)
+	{
+		maxLength = LZSS_F;
+	}
+
+	lzss_insert(state, aPos);
+	candidate = state->head[lzss_hash3(current)];
+
+	while ((candidate >= 0) && ((aPos - candidate) <= LZSS_MAX_DISTANCE) && (aChain-- > 0))
+	{
+		const uint8_t *ref = src + candidate;
+
+		if ((ref[bestLength] == current[bestLength]) && (ref[0] == current[0]) && (ref[1] == current[1]))
+		{
+			int64_t length = 2;
+
+			while ((length < maxLength) && (ref[length] == current[length]))
+			{
+				length++;
+			}
+
+			if (length > bestLength)
+			{
+				bestLength = length;
+				*aMatchPos = candidate;
+
+				if (length == maxLength)
+				{
+					break;
+				}
+			}
+		}
+
+		int64_t next = state->prev[candidate & (LZSS_N - 1)];
+
+		if (next >= candidate)
+		{
+			break;
+		}
+
+		candidate = next;
+	}
+
+	return (bestLength >= LZSS_MIN_MATCH) ? bestLength : 0;
+}
+
+//==============================================================================
+// Encodes src_size bytes at src. Returns the compressed size, or 0 when the
+// result does not fit in dst_size bytes (LZSS_ENCODE_BOUND is always enough).
+
+size_t lzss_encode(void * dst, size_t dst_size, const void * src, size_t src_size, int level)
+{
+	lzss_encoder	*state;
+	uint8_t			*out		= (uint8_t *)dst;
+	uint8_t			*outEnd		= out + dst_size;
+	uint8_t			*flags		= NULL;
+	int				items		= 8;
+	int64_t			pos			= 0;
+	int64_t			length, matchPos = 0;
+	int64_t			nextLength, nextMatchPos = 0;
+	lzss_level		effort;
+
+	if ((src_size > 0x7fffffff) || ((state = malloc(sizeof(lzss_encoder))) == NULL))
+	{
+		return 0;
+	}
+
+	if (level < 1)
+	{
+		level = 1;
+	}
+	else if (level > LZSS_MAX_LEVEL)
+	{
+		level = LZSS_MAX_LEVEL;
+	}
+
+	effort = lzss_levels[level];
+
+	memset(state->head, 0xff, sizeof(state->head));
+	state->src		= (const uint8_t *)src;
+	state->src_size	= (int64_t)src_size;
+	state->inserted	= 0;
+
+	while (pos < state->src_size)
+	{
+		length = lzss_find_match(state, pos, effort.chain, &matchPos);
+
+		// Lazy: a longer match at the next position wins over this one.
+		if (effort.lazy && length && (length < LZSS_F))
+		{
+			nextLength = lzss_find_match(state, pos + 1, effort.chain, &nextMatchPos);
+
+			if (nextLength > length)
+			{
+				length = 0;
+			}
+		}
+
+		// Room for a new flag byte and the literal or match.
+		if ((outEnd - out) < ((items == 8) + (length ? 2 : 1)))
+		{
+			free(state);
+			return 0;
+		}
+
+		if (items == 8)
+		{
+			flags	= out++;
+			*flags	= 0;
+			items	= 0;
+		}
+
+		if (length == 0)
+		{
+			*flags |= (1 << items);
+			*out++ = state->src[pos++];
+		}
+		else
+		{
+			uint32_t ring = (uint32_t)((LZSS_N - LZSS_F) + matchPos) & (LZSS_N - 1);
+
+			*out++ = (uint8_t)ring;
+			*out++ = (uint8_t)(((ring >> 4) & 0xf0) | (length - LZSS_MIN_MATCH));
+			pos += length;
+		}
+
+		items++;
+	}
+
+	free(state);
+
+	return out - (uint8_t *)dst;
+}
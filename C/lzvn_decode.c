@@ -31,10 +31,18 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 
 #include <libkern/OSByteOrder.h>
 
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+#include "../FastCompression.h"
+
 #define DEBUG_STATE_ENABLED		0
 
 #if DEBUG_STATE_ENABLED
@@ -58,9 +66,144 @@
 
 #define CASE_TABLE	127
 
+// lzvn_decode() itself is in lzvn_dispatch.c. lzvn_decode_threaded() is the
+// direct-threaded decoder when the compiler supports labels as values (GCC,
+// clang), or the switch() based one otherwise. Build with -DLZVN_NO_THREADED
+// to force the latter.
+#if defined(__GNUC__) && !defined(LZVN_NO_THREADED)
+#define LZVN_THREADED	1
+#else
+#define LZVN_THREADED	0
+#endif
+
+//==============================================================================
+
+static inline void lzvn_copy_match(uint8_t *dst, size_t D, size_t count)
+{
+	const uint8_t *ref = dst - D;
+
+	if (D >= 8)
+	{
+		// The source is at least 8 bytes behind, so qword copies never read unwritten bytes.
+		while (count >= 8)
+		{
+			memcpy(dst, ref, 8);
+			dst += 8;
+			ref += 8;
+			count -= 8;
+		}
+	}
+
+	while (count--)
+	{
+		*dst++ = *ref++;
+	}
+}
+
+//==============================================================================
+// Wide copies for the fast paths below. They copy whole 16/32 byte blocks and
+// may therefore write up to LZVN_WIDE_SLACK - 1 bytes past dst + count (and
+// read past src + count), so callers only use them when that much room is
+// left in both buffers.
+
+#define LZVN_WIDE_SLACK		32
+
+static inline void lzvn_copy16(uint8_t *dst, const uint8_t *src, size_t count)
+{
+	size_t i;
+
+	for (i = 0; i < count; i += 16)
+	{
+		memcpy(dst + i, src + i, 16);
+	}
+}
+
+static inline void lzvn_copy32(uint8_t *dst, const uint8_t *src, size_t count)
+{
+	size_t i;
+
+	for (i = 0; i < count; i += 32)
+	{
+		memcpy(dst + i, src + i, 32);
+	}
+}
+
+#if defined(__SSSE3__)
+// lzvn_pattern_mask[D][i] = i % D
+static const uint8_t lzvn_pattern_mask[16][16] __attribute__((aligned(16))) =
+{
+	{ 0 },
+	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+	{ 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1 },
+	{ 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0 },
+	{ 0, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3 },
+	{ 0, 1, 2, 3, 4, 0, 1, 2, 3, 4, 0, 1, 2, 3, 4, 0 },
+	{ 0, 1, 2, 3, 4, 5, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3 },
+	{ 0, 1, 2, 3, 4, 5, 6, 0, 1, 2, 3, 4, 5, 6, 0, 1 },
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 0, 1, 2, 3, 4, 5, 6, 7 },
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 0, 1, 2, 3, 4, 5, 6 },
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 0, 1, 2, 3, 4, 5 },
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 0, 1, 2, 3, 4 },
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 0, 1, 2, 3 },
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 0, 1, 2 },
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 0, 1 },
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 0 }
+};
+#endif
+
+//==============================================================================
+// Overlapping match with 0 < D < 16. The first 16 bytes are the D byte pattern
+// at dst - D repeated (one pshufb when SSSE3 is available). After that the
+// output repeats every D bytes, so the rest is copied in 16 byte blocks from
+// the smallest multiple of D that is >= 16 bytes back.
+
+static inline void lzvn_copy_pattern(uint8_t *dst, size_t D, size_t count)
+{
+	size_t i;
+
+#if defined(__SSSE3__)
+	__m128i pattern = _mm_loadu_si128((const __m128i *)(dst - D));
+
+	pattern = _mm_shuffle_epi8(pattern, _mm_load_si128((const __m128i *)lzvn_pattern_mask[D]));
+	_mm_storeu_si128((__m128i *)dst, pattern);
+#else
+	for (i = 0; i < 8; i++)
+	{
+		dst[i] = dst[i - D];
+	}
+
+	memcpy(dst + 8, dst + 8 - ((8 + D - 1) / D * D), 8);
+#endif
+
+	D = (16 + D - 1) / D * D;
+
+	for (i = 16; i < count; i += 16)
+	{
+		memcpy(dst + i, dst + i - D, 16);
+	}
+}
+
+//==============================================================================
+
+static inline void lzvn_copy_match_wide(uint8_t *dst, size_t D, size_t count)
+{
+	if (D >= 32)
+	{
+		lzvn_copy32(dst, dst - D, count);
+	}
+	else if (D >= 16)
+	{
+		lzvn_copy16(dst, dst - D, count);
+	}
+	else
+	{
+		lzvn_copy_pattern(dst, D, count);
+	}
+}
+
 //==============================================================================
 
-size_t lzvn_decode(void * decompressedData, size_t decompressedSize, void * compressedData, size_t compressedSize)
+size_t lzvn_decode_switch(void * decompressedData, size_t decompressedSize, const void * compressedData, size_t compressedSize)
 {
 	const uint64_t decompBuffer = (const uint64_t)decompressedData;
 
@@ -75,6 +218,8 @@ size_t lzvn_decode(void * decompressedData, size_t decompressedSize, void * comp
 	uint64_t negativeOffset	= 0;
 	uint64_t address		= 0;													// ((uint64_t)compBuffer + compBufferPointer)
 
+	uint64_t wideEnd		= 0;													// Last length for lzvn_copy*() (LZVN_WIDE_SLACK)
+
 	uint8_t jmpTo			= CASE_TABLE;											// On the first run!
 
 	// Example values:
@@ -121,6 +266,11 @@ size_t lzvn_decode(void * decompressedData, size_t decompressedSize, void * comp
 		return 0;
 	}
 
+	if ((decompressedSize + 8) >= LZVN_WIDE_SLACK)
+	{
+		wideEnd = (decompressedSize + 8 - LZVN_WIDE_SLACK);
+	}
+
 	compressedSize = (compBuffer + compressedSize - 8);								// lea	-0x8(%rdx,%rcx,1),%rcx
 
 	if (compBuffer > compressedSize)												// cmp	%rcx,%rdx
@@ -327,6 +477,19 @@ size_t lzvn_decode(void * decompressedData, size_t decompressedSize, void * comp
 					break;
 				}
 
+				// Wide fast path: room for 32 byte blocks in both buffers.
+				if ((currentLength <= wideEnd) && ((compBuffer + LZVN_WIDE_SLACK) <= (compressedSize + 8)))
+				{
+					lzvn_copy32((uint8_t *)decompBuffer + length, (const uint8_t *)(compBuffer + compBufferPointer), -compBufferPointer);
+					length = currentLength;
+
+					compBufferPointer = *(uint64_t *)compBuffer;
+					caseTableIndex = (compBufferPointer & 255);
+
+					jmpTo = CASE_TABLE;
+					break;
+				}
+
 				currentLength = (decompBuffer + currentLength);						// lea	(%rdi,%r11,1),%r11
 
 			case LZVN_1: /**********************************************************/
@@ -468,6 +631,19 @@ size_t lzvn_decode(void * decompressedData, size_t decompressedSize, void * comp
 
 					compBufferPointer -= negativeOffset;							// sub	%r12,%r8
 
+					// Wide fast path (vector copy or pattern shuffle).
+					if (negativeOffset && ((length + byteCount) <= wideEnd))
+					{
+						lzvn_copy_match_wide((uint8_t *)decompBuffer + length, negativeOffset, byteCount);
+						length += byteCount;
+
+						compBufferPointer = *(uint64_t *)compBuffer;
+						caseTableIndex = (compBufferPointer & 255);
+
+						jmpTo = CASE_TABLE;
+						break;
+					}
+
 					if (negativeOffset < 8)											// cmp	$0x8,%r12
 					{
 						jmpTo = LZVN_4;												// jb	Llzvn_l4
@@ -507,20 +683,20 @@ size_t lzvn_decode(void * decompressedData, size_t decompressedSize, void * comp
 					compBufferPointer >>= 8;										// shr	$0x8,%r8
 					caseTableIndex--;												// sub	$0x1,%r9
 						
-				} while (caseTableIndex != 1);										// jne	Llzvn_l6
+				} while (caseTableIndex != 0);										// jne	Llzvn_l6
 
 			case LZVN_7: /**********************************************************/
 
 				_LZVN_DEBUG_DUMP("jmpTable(7)\n");
 
-				compBufferPointer = length;											// mov	%rax,%r8
-				compBufferPointer -= negativeOffset;								// sub	%r12,%r8
-
-				if (compBufferPointer < negativeOffset)								// jb	Llzvn_exit
+				if (length < negativeOffset)										// jb	Llzvn_exit
 				{
 					return 0;
 				}
 
+				compBufferPointer = length;											// mov	%rax,%r8
+				compBufferPointer -= negativeOffset;								// sub	%r12,%r8
+
 				jmpTo = LZVN_4;
 				break;																// jmpq	*(%rbx,%r9,8)
 	
@@ -531,7 +707,20 @@ size_t lzvn_decode(void * decompressedData, size_t decompressedSize, void * comp
 				compBufferPointer = length;											// mov	%rax,%r8
 				compBufferPointer -= negativeOffset;								// sub	%r12,%r8
 				currentLength = (length + byteCount);								// lea	(%rax,%r10,1),%r11
-				
+
+				// Wide fast path (vector copy or pattern shuffle).
+				if (negativeOffset && (currentLength <= wideEnd))
+				{
+					lzvn_copy_match_wide((uint8_t *)decompBuffer + length, negativeOffset, byteCount);
+					length = currentLength;
+
+					compBufferPointer = *(uint64_t *)compBuffer;
+					caseTableIndex = (compBufferPointer & 255);
+
+					jmpTo = CASE_TABLE;
+					break;
+				}
+
 				if (currentLength < decompressedSize)								// cmp	%rsi,%r11
 				{
 					if (negativeOffset >= 8)										// cmp	$0x8,%r12
@@ -550,3 +739,901 @@ size_t lzvn_decode(void * decompressedData, size_t decompressedSize, void * comp
 	return 0;
 }
 
+
+//==============================================================================
+// Direct-threaded version of the decoder above. Like Lzvn_decode.opcode_table
+// in lzvn_decode.s, the first byte of every opcode indexes a table of label
+// addresses, and every handler ends with its own indirect jump to the next
+// one (instead of going through caseTable and the jmpTo switch). It accepts
+// and rejects the same input as lzvn_decode_switch(), except for a match
+// distance of 0, which is rejected instead of copying undefined bytes.
+//
+// With adler32 set, the wide copies stop at the end of each LZVN_ADLER32_SPAN
+// bytes of output, where lzvn_copy_tail updates *adler32 with the span (still
+// in cache). Without it the span is the whole buffer, and nothing changes.
+
+static size_t lzvn_decode_threaded_run(void * decompressedData, size_t decompressedSize, const void * compressedData, size_t compressedSize, uint32_t * adler32)
+{
+#if LZVN_THREADED
+	static const void * const opcodeTable[ 256 ] =
+	{
+#define SD	&&lzvn_sml_d
+#define MD	&&lzvn_med_d
+#define LD	&&lzvn_lrg_d
+#define PD	&&lzvn_pre_d
+#define SM	&&lzvn_sml_m
+#define LM	&&lzvn_lrg_m
+#define SL	&&lzvn_sml_l
+#define LL	&&lzvn_lrg_l
+#define NP	&&lzvn_nop
+#define EO	&&lzvn_eos
+#define UD	&&lzvn_udef
+		SD, SD, SD, SD,   SD, SD, EO, LD,   SD, SD, SD, SD,   SD, SD, NP, LD,
+		SD, SD, SD, SD,   SD, SD, NP, LD,   SD, SD, SD, SD,   SD, SD, UD, LD,
+		SD, SD, SD, SD,   SD, SD, UD, LD,   SD, SD, SD, SD,   SD, SD, UD, LD,
+		SD, SD, SD, SD,   SD, SD, UD, LD,   SD, SD, SD, SD,   SD, SD, UD, LD,
+		SD, SD, SD, SD,   SD, SD, PD, LD,   SD, SD, SD, SD,   SD, SD, PD, LD,
+		SD, SD, SD, SD,   SD, SD, PD, LD,   SD, SD, SD, SD,   SD, SD, PD, LD,
+		SD, SD, SD, SD,   SD, SD, PD, LD,   SD, SD, SD, SD,   SD, SD, PD, LD,
+		UD, UD, UD, UD,   UD, UD, UD, UD,   UD, UD, UD, UD,   UD, UD, UD, UD,
+		SD, SD, SD, SD,   SD, SD, PD, LD,   SD, SD, SD, SD,   SD, SD, PD, LD,
+		SD, SD, SD, SD,   SD, SD, PD, LD,   SD, SD, SD, SD,   SD, SD, PD, LD,
+		MD, MD, MD, MD,   MD, MD, MD, MD,   MD, MD, MD, MD,   MD, MD, MD, MD,
+		MD, MD, MD, MD,   MD, MD, MD, MD,   MD, MD, MD, MD,   MD, MD, MD, MD,
+		SD, SD, SD, SD,   SD, SD, PD, LD,   SD, SD, SD, SD,   SD, SD, PD, LD,
+		UD, UD, UD, UD,   UD, UD, UD, UD,   UD, UD, UD, UD,   UD, UD, UD, UD,
+		LL, SL, SL, SL,   SL, SL, SL, SL,   SL, SL, SL, SL,   SL, SL, SL, SL,
+		LM, SM, SM, SM,   SM, SM, SM, SM,   SM, SM, SM, SM,   SM, SM, SM, SM
+#undef SD
+#undef MD
+#undef LD
+#undef PD
+#undef SM
+#undef LM
+#undef SL
+#undef LL
+#undef NP
+#undef EO
+#undef UD
+	};
+
+	uint8_t			*dstBegin	= (uint8_t *)decompressedData;
+	uint8_t			*dst		= dstBegin;
+	uint8_t			*dstEnd		= dstBegin + decompressedSize;
+	uint8_t			*spanEnd	= dstEnd;											// Wide copies stay in front of this.
+	uint8_t			*checked	= dstBegin;											// Output in *adler32.
+	const uint8_t	*src		= (const uint8_t *)compressedData;
+	const uint8_t	*srcLimit;														// Last position of an opcode (8 readable bytes).
+	size_t			L, M, D		= 0;
+	size_t			count;
+	uint8_t			opcode;
+
+	// Same limits as lzvn_decode_switch().
+	if ((decompressedSize < 16) || (compressedSize < 8))
+	{
+		return 0;
+	}
+
+	srcLimit = src + compressedSize - 8;
+
+	if ((adler32 != NULL) && (decompressedSize > LZVN_ADLER32_SPAN))
+	{
+		spanEnd = dstBegin + LZVN_ADLER32_SPAN;
+	}
+
+// Check the position and jump to the handler of the next opcode.
+#define LZVN_NEXT()																		\
+	do {																				\
+		if (src > srcLimit)																\
+		{																				\
+			return 0;																	\
+		}																				\
+		opcode = src[0];																\
+		goto *opcodeTable[opcode];														\
+	} while (0)
+
+// Copy L literals (from src) and an M byte match at distance D, then go to
+// the next opcode. Wide copies when both buffers have enough slack.
+#define LZVN_COPY_NEXT()																\
+	do {																				\
+		if (((size_t)(spanEnd - dst) >= (L + M + LZVN_WIDE_SLACK))						\
+			&& ((src + L + LZVN_WIDE_SLACK) <= srcLimit))								\
+		{																				\
+			lzvn_copy32(dst, src, L);													\
+			dst += L;																	\
+			src += L;																	\
+			if (M)																		\
+			{																			\
+				if ((D == 0) || (D > (size_t)(dst - dstBegin)))							\
+				{																		\
+					return 0;															\
+				}																		\
+				lzvn_copy_match_wide(dst, D, M);										\
+				dst += M;																\
+			}																			\
+			LZVN_NEXT();																\
+		}																				\
+		goto lzvn_copy_tail;															\
+	} while (0)
+
+// Same for the distance opcodes, where L <= 3 and M <= 34: the literals are
+// stored with one 8 byte write (as lzvn_decode.s does).
+#define LZVN_COPY_SHORT_NEXT()															\
+	do {																				\
+		if (((size_t)(spanEnd - dst) >= (3 + 34 + LZVN_WIDE_SLACK))						\
+			&& ((src + L) <= srcLimit))													\
+		{																				\
+			memcpy(dst, src, 8);														\
+			dst += L;																	\
+			src += L;																	\
+			if ((D == 0) || (D > (size_t)(dst - dstBegin)))								\
+			{																			\
+				return 0;																\
+			}																			\
+			if (D >= 16)																\
+			{																			\
+				lzvn_copy16(dst, dst - D, M);											\
+			}																			\
+			else																		\
+			{																			\
+				lzvn_copy_pattern(dst, D, M);											\
+			}																			\
+			dst += M;																	\
+			LZVN_NEXT();																\
+		}																				\
+		goto lzvn_copy_tail;															\
+	} while (0)
+
+	LZVN_NEXT();
+
+lzvn_sml_d:																				// LLMMMDDD DDDDDDDD
+	L = opcode >> 6;
+	M = ((opcode >> 3) & 7) + 3;
+	D = ((opcode & 7) << 8) | src[1];
+	src += 2;
+	LZVN_COPY_SHORT_NEXT();
+
+lzvn_med_d:																				// 101LLMMM DDDDDDMM DDDDDDDD
+	L = (opcode >> 3) & 3;
+	M = (((opcode & 7) << 2) | (src[1] & 3)) + 3;
+	D = (src[1] >> 2) | (src[2] << 6);
+	src += 3;
+	LZVN_COPY_SHORT_NEXT();
+
+lzvn_lrg_d:																				// LLMMM111 DDDDDDDD DDDDDDDD
+	L = opcode >> 6;
+	M = ((opcode >> 3) & 7) + 3;
+	D = src[1] | (src[2] << 8);
+	src += 3;
+	LZVN_COPY_SHORT_NEXT();
+
+lzvn_pre_d:																				// LLMMM110
+	L = opcode >> 6;
+	M = ((opcode >> 3) & 7) + 3;
+	src += 1;
+	LZVN_COPY_SHORT_NEXT();
+
+lzvn_sml_m:																				// 1111MMMM
+	L = 0;
+	M = opcode & 0x0f;
+	src += 1;
+	LZVN_COPY_NEXT();
+
+lzvn_lrg_m:																				// 11110000 MMMMMMMM
+	L = 0;
+	M = src[1] + 16;
+	src += 2;
+	LZVN_COPY_NEXT();
+
+lzvn_sml_l:																				// 1110LLLL
+	L = opcode & 0x0f;
+	M = 0;
+	src += 1;
+	LZVN_COPY_NEXT();
+
+lzvn_lrg_l:																				// 11100000 LLLLLLLL
+	L = src[1] + 16;
+	M = 0;
+	src += 2;
+	LZVN_COPY_NEXT();
+
+lzvn_nop:
+	src += 1;
+	LZVN_NEXT();
+
+lzvn_eos:
+	goto lzvn_done;
+
+lzvn_udef:
+	return 0;
+
+lzvn_copy_tail:																			// Close to the end of either buffer, or of the span.
+	if (spanEnd != dstEnd)
+	{
+		*adler32 = lzvn_adler32(*adler32, checked, dst - checked);
+		checked = dst;
+		spanEnd = ((size_t)(dstEnd - dst) > LZVN_ADLER32_SPAN) ? (dst + LZVN_ADLER32_SPAN) : dstEnd;
+	}
+
+	if ((src + L) > srcLimit)
+	{
+		return 0;
+	}
+
+	count = ((size_t)(dstEnd - dst) < L) ? (size_t)(dstEnd - dst) : L;
+	memcpy(dst, src, count);
+	dst += count;
+	src += L;
+
+	if (count < L)
+	{
+		goto lzvn_done;																	// Output buffer full.
+	}
+
+	if (M)
+	{
+		if ((D == 0) || (D > (size_t)(dst - dstBegin)))
+		{
+			return 0;
+		}
+
+		count = ((size_t)(dstEnd - dst) < M) ? (size_t)(dstEnd - dst) : M;
+		lzvn_copy_match(dst, D, count);
+		dst += count;
+
+		if (count < M)
+		{
+			goto lzvn_done;																// Output buffer full.
+		}
+	}
+
+	LZVN_NEXT();
+
+lzvn_done:
+	if (adler32 != NULL)
+	{
+		*adler32 = lzvn_adler32(*adler32, checked, dst - checked);
+	}
+
+	return dst - dstBegin;
+
+#undef LZVN_COPY_SHORT_NEXT
+#undef LZVN_COPY_NEXT
+#undef LZVN_NEXT
+#else
+	size_t size = lzvn_decode_switch(decompressedData, decompressedSize, compressedData, compressedSize);
+
+	if ((adler32 != NULL) && (size != 0))
+	{
+		*adler32 = lzvn_adler32(*adler32, (const uint8_t *)decompressedData, size);
+	}
+
+	return size;
+#endif
+}
+
+size_t lzvn_decode_threaded(void * decompressedData, size_t decompressedSize, const void * compressedData, size_t compressedSize)
+{
+	return lzvn_decode_threaded_run(decompressedData, decompressedSize, compressedData, compressedSize, NULL);
+}
+
+//==============================================================================
+// lzvn_decode_threaded() and the adler32 of the output in one pass.
+
+size_t lzvn_decode_threaded_adler32(void * decompressedData, size_t decompressedSize, const void * compressedData, size_t compressedSize, uint32_t * adler32)
+{
+	return lzvn_decode_threaded_run(decompressedData, decompressedSize, compressedData, compressedSize, adler32);
+}
+
+#ifndef LZVN_DECODE_VARIANT
+// Not needed in the CPU specific builds (lzvn_decode_ssse3.c, lzvn_decode_avx2.c).
+
+//==============================================================================
+// Resumable decoder. Unlike lzvn_decode(), which needs all input and output at
+// once, lzvn_decoder_run() stops when either runs out and continues from the
+// saved state on the next call:
+//
+//  - src..src_end: when the call returns, state->src points at the first byte
+//    that wasn't used. A partial opcode at the end is left there, so the caller
+//    must present those bytes again, followed by more input.
+//  - dst_begin..dst_end: output goes to dst, matches can reference everything
+//    from dst_begin. lzvn_decoder_slide() moves the last LZVN_DECODER_HISTORY
+//    bytes to dst_begin, so one buffer of 64 KB plus a block is enough to
+//    decode a stream of any size.
+//
+// Returns 1 at the end of the stream, 0 when paused and -1 on invalid input.
+
+void lzvn_decoder_init(lzvn_decoder_state * state, void * dst, size_t dst_size)
+{
+	memset(state, 0, sizeof(lzvn_decoder_state));
+
+	state->dst_begin	= (unsigned char *)dst;
+	state->dst			= (unsigned char *)dst;
+	state->dst_end		= (unsigned char *)dst + dst_size;
+}
+
+//==============================================================================
+
+int lzvn_decoder_run(lzvn_decoder_state * state)
+{
+	const uint8_t	*src		= state->src;
+	const uint8_t	*src_end	= state->src_end;
+	uint8_t			*dst		= state->dst;
+	uint8_t			*dst_end	= state->dst_end;
+	size_t			L			= state->L;
+	size_t			M			= state->M;
+	size_t			D			= state->D;
+	size_t			count;
+	int				status		= 0;
+
+	if (state->end_of_stream)
+	{
+		return 1;
+	}
+
+	for ( ; ; )
+	{
+		uint8_t		opcode;
+		size_t		length;
+
+		if (L)
+		{
+			count = L;
+			count = (count < (size_t)(src_end - src)) ? count : (size_t)(src_end - src);
+			count = (count < (size_t)(dst_end - dst)) ? count : (size_t)(dst_end - dst);
+
+			memcpy(dst, src, count);
+			dst	+= count;
+			src	+= count;
+			L	-= count;
+
+			if (L)
+			{
+				break;																	// Out of input or output.
+			}
+		}
+
+		if (M)
+		{
+			if ((D == 0) || (D > (size_t)(dst - state->dst_begin)))
+			{
+				status = -1;
+				break;
+			}
+
+			count = (M < (size_t)(dst_end - dst)) ? M : (size_t)(dst_end - dst);
+
+			lzvn_copy_match(dst, D, count);
+			dst	+= count;
+			M	-= count;
+
+			if (M)
+			{
+				break;																	// Out of output.
+			}
+		}
+
+		// Fast path: whole opcodes, no partial copies, while both buffers have
+		// room for the largest one (plus LZVN_WIDE_SLACK). Anything unusual is
+		// left to the code below.
+		while (((size_t)(src_end - src) >= (3 + 271 + LZVN_WIDE_SLACK))
+			&& ((size_t)(dst_end - dst) >= (271 + 271 + LZVN_WIDE_SLACK)))
+		{
+			opcode = src[0];
+
+			if (opcode < 0xa0 || (opcode >= 0xc0 && opcode < 0xd0))
+			{
+				if ((opcode >= 0x70) && (opcode < 0x80))
+				{
+					break;																	// undefined
+				}
+				else if ((opcode & 7) == 7)
+				{
+					D = src[1] | (src[2] << 8);												// lrg_d
+					src += 3;
+				}
+				else if ((opcode & 7) == 6)
+				{
+					if (opcode < 0x40)
+					{
+						break;																// eos, nop, undefined
+					}
+
+					src += 1;																// pre_d
+				}
+				else
+				{
+					D = ((opcode & 7) << 8) | src[1];										// sml_d
+					src += 2;
+				}
+
+				L = opcode >> 6;
+				M = ((opcode >> 3) & 7) + 3;
+			}
+			else if (opcode < 0xc0)
+			{
+				L = (opcode >> 3) & 3;														// med_d
+				M = (((opcode & 7) << 2) | (src[1] & 3)) + 3;
+				D = (src[1] >> 2) | (src[2] << 6);
+				src += 3;
+			}
+			else if (opcode < 0xe0)
+			{
+				break;																		// undefined
+			}
+			else if (opcode & 0x0f)
+			{
+				if (opcode >= 0xf0)
+				{
+					M = opcode & 0x0f;														// sml_m
+				}
+				else
+				{
+					L = opcode & 0x0f;														// sml_l
+				}
+
+				src += 1;
+			}
+			else
+			{
+				if (opcode == 0xf0)
+				{
+					M = src[1] + 16;														// lrg_m
+				}
+				else
+				{
+					L = src[1] + 16;														// lrg_l
+				}
+
+				src += 2;
+			}
+
+			if (L)
+			{
+				lzvn_copy32(dst, src, L);
+				dst	+= L;
+				src	+= L;
+				L	= 0;
+			}
+
+			if (M)
+			{
+				if ((D == 0) || (D > (size_t)(dst - state->dst_begin)))
+				{
+					break;																	// Reported by the M copy above.
+				}
+
+				lzvn_copy_match_wide(dst, D, M);
+
+				dst	+= M;
+				M	= 0;
+			}
+		}
+
+		if (M)
+		{
+			continue;
+		}
+
+		if (src >= src_end)
+		{
+			break;
+		}
+
+		opcode = src[0];
+
+		// Opcode length (see caseTable in lzvn_decode above).
+		if (opcode >= 0xe0)
+		{
+			length = ((opcode & 0x0f) == 0) ? 2 : 1;										// lrg_l/lrg_m : sml_l/sml_m
+		}
+		else if ((opcode >= 0xa0) && (opcode < 0xc0))
+		{
+			length = 3;																		// med_d
+		}
+		else if (((opcode >= 0x70) && (opcode < 0x80)) || ((opcode >= 0xd0) && (opcode < 0xe0)))
+		{
+			status = -1;																	// undefined
+			break;
+		}
+		else if ((opcode & 7) == 6)
+		{
+			if (opcode == 0x06)
+			{
+				src++;
+				state->end_of_stream = 1;													// eos
+				status = 1;
+				break;
+			}
+
+			if (opcode < 0x40)
+			{
+				if ((opcode != 0x0e) && (opcode != 0x16))
+				{
+					status = -1;															// undefined
+					break;
+				}
+
+				src++;																		// nop
+				continue;
+			}
+
+			length = 1;																		// pre_d
+		}
+		else
+		{
+			length = ((opcode & 7) == 7) ? 3 : 2;											// lrg_d : sml_d
+		}
+
+		if ((size_t)(src_end - src) < length)
+		{
+			break;																			// Partial opcode.
+		}
+
+		if (opcode >= 0xf0)
+		{
+			M = (length == 2) ? (src[1] + 16) : (opcode & 0x0f);						// lrg_m / sml_m
+		}
+		else if (opcode >= 0xe0)
+		{
+			L = (length == 2) ? (src[1] + 16) : (opcode & 0x0f);						// lrg_l / sml_l
+		}
+		else if (length == 3 && (opcode >= 0xa0) && (opcode < 0xc0))
+		{
+			L = (opcode >> 3) & 3;															// med_d
+			M = (((opcode & 7) << 2) | (src[1] & 3)) + 3;
+			D = (src[1] >> 2) | (src[2] << 6);
+		}
+		else
+		{
+			L = opcode >> 6;
+			M = ((opcode >> 3) & 7) + 3;
+
+			if (length == 3)
+			{
+				D = src[1] | (src[2] << 8);													// lrg_d
+			}
+			else if (length == 2)
+			{
+				D = ((opcode & 7) << 8) | src[1];											// sml_d
+			}
+		}
+
+		src += length;
+	}
+
+	state->src	= src;
+	state->dst	= dst;
+	state->L	= L;
+	state->M	= M;
+	state->D	= D;
+
+	return status;
+}
+
+//==============================================================================
+// Keep the last LZVN_DECODER_HISTORY bytes of output at dst_begin, so decoding
+// can continue in the same buffer. Returns the number of bytes dropped.
+
+size_t lzvn_decoder_slide(lzvn_decoder_state * state)
+{
+	size_t	used = state->dst - state->dst_begin;
+	size_t	drop;
+
+	if (used <= LZVN_DECODER_HISTORY)
+	{
+		return 0;
+	}
+
+	drop = used - LZVN_DECODER_HISTORY;
+
+	memmove(state->dst_begin, state->dst_begin + drop, LZVN_DECODER_HISTORY);
+	state->dst -= drop;
+
+	return drop;
+}
+
+//==============================================================================
+// Checkpoint index, see lzvn_index_header in FastCompression.h.
+
+#define LZVN_RANGE_BLOCK		(1 << 20)			// lzvn_decode_range() output per lzvn_decoder_run()
+
+size_t lzvn_index_size(size_t dst_size, size_t spacing)
+{
+	return sizeof(lzvn_index_header) + ((dst_size + spacing - 1) / spacing) * sizeof(lzvn_index_entry);
+}
+
+static int lzvn_index_valid(const lzvn_index_header *aHeader, size_t aIndexSize, size_t aSrcSize)
+{
+	const lzvn_index_entry	*entry = (const lzvn_index_entry *)(aHeader + 1);
+	uint32_t				i;
+
+	if ((aIndexSize < sizeof(lzvn_index_header)) || (aHeader->magic != LZVN_INDEX_MAGIC) || (aHeader->spacing == 0)
+		|| (aHeader->src_size != aSrcSize) || (aHeader->count != (aHeader->dst_size + aHeader->spacing - 1) / aHeader->spacing)
+		|| (aIndexSize < lzvn_index_size(aHeader->dst_size, aHeader->spacing)))
+	{
+		return 0;
+	}
+
+	for (i = 0; i < aHeader->count; i++, entry++)
+	{
+		if ((entry->src_offset > aSrcSize) || (entry->dst_offset != i * aHeader->spacing)
+			|| (entry->window_size != ((entry->dst_offset < LZVN_DECODER_HISTORY) ? entry->dst_offset : LZVN_DECODER_HISTORY)))
+		{
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+//==============================================================================
+// Decode the whole stream (as lzvn_decode) and fill in index_size bytes of
+// index (lzvn_index_size(dst_size, spacing)) on the way, including the adler32
+// of the output. Returns the decoded size, or 0 on error.
+
+size_t lzvn_decode_index(void * dst, size_t dst_size, const void * src, size_t src_size, void * index, size_t index_size, size_t spacing)
+{
+	lzvn_index_header	*header		= (lzvn_index_header *)index;
+	lzvn_index_entry	*entry		= (lzvn_index_entry *)(header + 1);
+	lzvn_decoder_state	state;
+	uint8_t				*dst_limit	= (uint8_t *)dst + dst_size;
+	uint8_t				*checked	= (uint8_t *)dst;
+	uint8_t				*next		= (uint8_t *)dst;			// next checkpoint
+	uint32_t			adler32		= 1;
+	int					status;
+
+	if ((spacing == 0) || (index_size < lzvn_index_size(dst_size, spacing)))
+	{
+		return 0;
+	}
+
+	memset(header, 0, sizeof(lzvn_index_header));
+
+	header->magic		= LZVN_INDEX_MAGIC;
+	header->spacing		= spacing;
+	header->src_size	= src_size;
+	header->dst_size	= dst_size;
+
+	lzvn_decoder_init(&state, dst, 0);
+
+	state.src		= (const unsigned char *)src;
+	state.src_end	= (const unsigned char *)src + src_size;
+
+	do
+	{
+		if ((state.dst == next) && (next < dst_limit))
+		{
+			size_t offset = state.dst - state.dst_begin;
+
+			entry->src_offset	= state.src - (const unsigned char *)src;
+			entry->dst_offset	= offset;
+			entry->L			= (uint32_t)state.L;
+			entry->M			= (uint32_t)state.M;
+			entry->D			= (uint32_t)state.D;
+			entry->window_size	= (offset < LZVN_DECODER_HISTORY) ? (uint32_t)offset : LZVN_DECODER_HISTORY;
+
+			memcpy(entry->window, state.dst - entry->window_size, entry->window_size);
+
+			entry++;
+			header->count++;
+			next = ((size_t)(dst_limit - next) > spacing) ? next + spacing : dst_limit;
+		}
+
+		// Stop at the next checkpoint, and every LZVN_ADLER32_SPAN bytes for the adler32.
+		state.dst_end = ((size_t)(next - state.dst) > LZVN_ADLER32_SPAN) ? state.dst + LZVN_ADLER32_SPAN : next;
+
+		status = lzvn_decoder_run(&state);
+
+		adler32 = lzvn_adler32(adler32, checked, state.dst - checked);
+		checked = state.dst;
+	}
+	while ((status == 0) && (state.dst == state.dst_end) && (state.dst < dst_limit));
+
+	if ((status == -1) || ((status == 0) && (state.dst < dst_limit)))
+	{
+		return 0;
+	}
+
+	header->adler32 = adler32;
+
+	return state.dst - state.dst_begin;
+}
+
+//==============================================================================
+// Decode size bytes of output from offset onwards into dst, starting at the
+// last checkpoint in front of offset, so the cost is that of at most spacing
+// plus size bytes, whatever the size of the stream. Returns the number of bytes
+// written (less than size at the end of the data), or 0 on error or when the
+// index does not belong to src.
+
+size_t lzvn_decode_range(void * dst, size_t offset, size_t size, const void * src, size_t src_size, const void * index, size_t index_size)
+{
+	const lzvn_index_header	*header		= (const lzvn_index_header *)index;
+	const lzvn_index_entry	*entry;
+	lzvn_decoder_state		state;
+	uint8_t					*window;
+	uint8_t					*window_end;
+	uint8_t					*from;
+	size_t					position, end, count, skip;
+	size_t					copied		= 0;
+	int						status		= 0;
+
+	if (!lzvn_index_valid(header, index_size, src_size) || (offset >= header->dst_size))
+	{
+		return 0;
+	}
+
+	end		= ((header->dst_size - offset) < size) ? header->dst_size : (offset + size);
+	entry	= (const lzvn_index_entry *)(header + 1) + (offset / header->spacing);
+
+	if ((window = malloc(LZVN_DECODER_HISTORY + LZVN_RANGE_BLOCK)) == NULL)
+	{
+		return 0;
+	}
+
+	window_end = window + LZVN_DECODER_HISTORY + LZVN_RANGE_BLOCK;
+
+	memcpy(window, entry->window, entry->window_size);
+	lzvn_decoder_init(&state, window, 0);
+
+	state.dst		= window + entry->window_size;
+	state.src		= (const unsigned char *)src + entry->src_offset;
+	state.src_end	= (const unsigned char *)src + src_size;
+	state.L			= entry->L;
+	state.M			= entry->M;
+	state.D			= entry->D;
+	position		= entry->dst_offset;						// of state.dst
+
+	while (position < end)
+	{
+		if (state.dst == window_end)
+		{
+			lzvn_decoder_slide(&state);
+		}
+
+		from			= state.dst;
+		state.dst_end	= ((end - position) < (size_t)(window_end - state.dst)) ? (state.dst + (end - position)) : window_end;
+		status			= lzvn_decoder_run(&state);
+		count			= state.dst - from;
+
+		// Output from position to position + count, keep what is in the range.
+		if ((position + count) > offset)
+		{
+			skip = (offset > position) ? (offset - position) : 0;
+
+			memcpy((uint8_t *)dst + copied, from + skip, count - skip);
+			copied += count - skip;
+		}
+
+		position += count;
+
+		if ((status != 0) || (count == 0))
+		{
+			break;																		// End of stream, error or out of input.
+		}
+	}
+
+	free(window);
+
+	return (status == -1) ? 0 : copied;
+}
+
+//==============================================================================
+// Bytes needed on top of dst_size to decode in place (lzvn_decode_in_place):
+// with the src_size byte stream at the end of the buffer, the output must
+// never reach input that has yet to be read. Every decoder reads an opcode and
+// its literals before writing them, and writes at most LZVN_WIDE_SLACK bytes
+// past the end of its output, so for each opcode:
+//
+//   write end (+ LZVN_WIDE_SLACK, up to dst_size) <= buffer size - src_size
+//                                                    + input used so far
+//
+// Walks the opcodes without decoding them. Returns (size_t)-1 for a stream
+// that is truncated or has undefined opcodes.
+
+size_t lzvn_decode_in_place_margin(const void * src, size_t src_size, size_t dst_size)
+{
+	const uint8_t	*in		= (const uint8_t *)src;
+	size_t			pos		= 0;		// input used
+	size_t			out		= 0;		// output written
+	size_t			length, L, M, end;
+	int64_t			gap		= 0;		// largest write end - input used
+	int64_t			margin;
+
+	while (out < dst_size)
+	{
+		uint8_t opcode;
+
+		if (pos >= src_size)
+		{
+			return (size_t)-1;
+		}
+
+		opcode	= in[pos];
+		L		= 0;
+		M		= 0;
+
+		// Same opcode classes as lzvn_decoder_run().
+		if (opcode >= 0xe0)
+		{
+			length = ((opcode & 0x0f) == 0) ? 2 : 1;										// lrg_l/lrg_m : sml_l/sml_m
+		}
+		else if ((opcode >= 0xa0) && (opcode < 0xc0))
+		{
+			length = 3;																		// med_d
+		}
+		else if (((opcode >= 0x70) && (opcode < 0x80)) || ((opcode >= 0xd0) && (opcode < 0xe0)))
+		{
+			return (size_t)-1;																// undefined
+		}
+		else if ((opcode & 7) == 6)
+		{
+			if (opcode == 0x06)
+			{
+				break;																		// eos
+			}
+
+			if (opcode < 0x40)
+			{
+				if ((opcode != 0x0e) && (opcode != 0x16))
+				{
+					return (size_t)-1;														// undefined
+				}
+
+				pos++;																		// nop
+				continue;
+			}
+
+			length = 1;																		// pre_d
+		}
+		else
+		{
+			length = ((opcode & 7) == 7) ? 3 : 2;											// lrg_d : sml_d
+		}
+
+		if ((src_size - pos) < length)
+		{
+			return (size_t)-1;
+		}
+
+		if (opcode >= 0xf0)
+		{
+			M = (length == 2) ? (in[pos + 1] + 16) : (opcode & 0x0f);						// lrg_m / sml_m
+		}
+		else if (opcode >= 0xe0)
+		{
+			L = (length == 2) ? (in[pos + 1] + 16) : (opcode & 0x0f);						// lrg_l / sml_l
+		}
+		else if ((opcode >= 0xa0) && (opcode < 0xc0))
+		{
+			L = (opcode >> 3) & 3;															// med_d
+			M = (((opcode & 7) << 2) | (in[pos + 1] & 3)) + 3;
+		}
+		else
+		{
+			L = opcode >> 6;
+			M = ((opcode >> 3) & 7) + 3;
+		}
+
+		if ((src_size - pos - length) < L)
+		{
+			return (size_t)-1;
+		}
+
+		pos	+= length + L;
+		out	+= L + M;
+		end	= ((out + LZVN_WIDE_SLACK) < dst_size) ? (out + LZVN_WIDE_SLACK) : dst_size;
+
+		if (((int64_t)end - (int64_t)pos) > gap)
+		{
+			gap = (int64_t)end - (int64_t)pos;
+		}
+	}
+
+	margin = gap + (int64_t)src_size - (int64_t)dst_size;
+
+	return (margin > 0) ? (size_t)margin : 0;
+}
+
+#endif /* LZVN_DECODE_VARIANT */
@@ -0,0 +1,15 @@
+/*
+ * Created..: 16 October 2026
+ * Filename.: lzvn_decode_avx2.c
+ * Purpose..: lzvn_decode.c built with -mavx2 -mbmi2 (32-byte copies in one
+ *            register, shrx/bzhi for the opcode fields), picked by
+ *            lzvn_dispatch.c on CPUs with AVX2 and BMI2.
+ */
+
+#define LZVN_DECODE_VARIANT
+
+#define lzvn_decode_switch		lzvn_decode_switch_avx2
+#define lzvn_decode_threaded	lzvn_decode_threaded_avx2
+#define lzvn_decode_threaded_adler32	lzvn_decode_threaded_adler32_avx2
+
+#include "lzvn_decode.c"
@@ -0,0 +1,14 @@
+/*
+ * Created..: 16 October 2026
+ * Filename.: lzvn_decode_ssse3.c
+ * Purpose..: lzvn_decode.c built with -mssse3 (pshufb pattern copies), picked
+ *            by lzvn_dispatch.c on CPUs with SSSE3.
+ */
+
+#define LZVN_DECODE_VARIANT
+
+#define lzvn_decode_switch		lzvn_decode_switch_ssse3
+#define lzvn_decode_threaded	lzvn_decode_threaded_ssse3
+#define lzvn_decode_threaded_adler32	lzvn_decode_threaded_adler32_ssse3
+
+#include "lzvn_decode.c"
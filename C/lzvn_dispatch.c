@@ -0,0 +1,262 @@
+/*
+ * Created..: 16 October 2026
+ * Filename.: lzvn_dispatch.c
+ * Purpose..: lzvn_encode() and lzvn_decode() pick the fastest backend in the
+ *            library for the CPU they run on.
+ *
+ * Decoders, fastest first (see bench/lzvn_decode_bench):
+ *
+ *   avx2      lzvn_decode.c built with -mavx2 -mbmi2, needs AVX2 and BMI2.
+ *   ssse3     lzvn_decode.c built with -mssse3, needs SSSE3.
+ *   threaded  direct-threaded C decoder (SSE2, any x86_64).
+ *   asm       lzvn_decode.s.
+ *   switch    switch() based C decoder, the reference.
+ *
+ * Encoders: asm (lzvn_encode.s) and c (C/lzvn_encode.c). They produce
+ * different, equally valid, streams.
+ *
+ * The choice is made from CPUID on the first call, unless the LZVN_DECODER or
+ * LZVN_ENCODER environment variable names a backend, or the program calls
+ * lzvn_select_decoder()/lzvn_select_encoder() (lzvn -decoder/-encoder).
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "../FastCompression.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define LZVN_DISPATCH_X86	1
+#else
+#define LZVN_DISPATCH_X86	0
+#endif
+
+typedef struct
+{
+	const char					*name;
+	lzvn_decode_func			decode;
+	lzvn_decode_adler32_func	decode_adler32;		// NULL: decode, then lzvn_adler32()
+	const char					*features[2];		// CPU features needed (NULL = none)
+} lzvn_decoder_backend;
+
+typedef struct
+{
+	const char			*name;
+	lzvn_encode_func	encode;
+} lzvn_encoder_backend;
+
+static const lzvn_decoder_backend gDecoders[] =
+{
+#if LZVN_DISPATCH_X86
+	{ "avx2",		lzvn_decode_threaded_avx2,	lzvn_decode_threaded_adler32_avx2,	{ "avx2", "bmi2" } },
+	{ "ssse3",		lzvn_decode_threaded_ssse3,	lzvn_decode_threaded_adler32_ssse3,	{ "ssse3", NULL } },
+#endif
+	{ "threaded",	lzvn_decode_threaded,		lzvn_decode_threaded_adler32,		{ NULL, NULL } },
+#if LZVN_DISPATCH_X86
+	{ "asm",		lzvn_decode_asm,			NULL,								{ NULL, NULL } },
+#endif
+	{ "switch",		lzvn_decode_switch,			NULL,								{ NULL, NULL } }
+};
+
+static const lzvn_encoder_backend gEncoders[] =
+{
+#if LZVN_DISPATCH_X86
+	{ "asm",		lzvn_encode_asm },
+#endif
+	{ "c",			lzvn_encode_c }
+};
+
+#define LZVN_DECODERS	(int)(sizeof(gDecoders) / sizeof(gDecoders[0]))
+#define LZVN_ENCODERS	(int)(sizeof(gEncoders) / sizeof(gEncoders[0]))
+
+static const lzvn_decoder_backend	*gDecoder = NULL;
+static const lzvn_encoder_backend	*gEncoder = NULL;
+
+//==============================================================================
+// __builtin_cpu_supports() wants a string literal, hence the list.
+
+static int lzvn_cpu_supports(const char *aFeature)
+{
+	if (aFeature == NULL)
+	{
+		return 1;
+	}
+
+#if LZVN_DISPATCH_X86
+	__builtin_cpu_init();
+
+	if (!strcmp(aFeature, "avx2"))
+	{
+		return __builtin_cpu_supports("avx2");
+	}
+
+	if (!strcmp(aFeature, "bmi2"))
+	{
+		return __builtin_cpu_supports("bmi2");
+	}
+
+	if (!strcmp(aFeature, "ssse3"))
+	{
+		return __builtin_cpu_supports("ssse3");
+	}
+#endif
+
+	return 0;
+}
+
+static int lzvn_decoder_usable(const lzvn_decoder_backend *aBackend)
+{
+	return lzvn_cpu_supports(aBackend->features[0]) && lzvn_cpu_supports(aBackend->features[1]);
+}
+
+//==============================================================================
+// NULL or "auto" selects the fastest usable decoder. Returns -1 for an unknown
+// name or a backend this CPU can't run (the selection is left as it was).
+
+int lzvn_select_decoder(const char * name)
+{
+	int i;
+
+	for (i = 0; i < LZVN_DECODERS; i++)
+	{
+		if (((name == NULL) || !strcmp(name, "auto") || !strcmp(name, gDecoders[i].name)) && lzvn_decoder_usable(&gDecoders[i]))
+		{
+			gDecoder = &gDecoders[i];
+			return 0;
+		}
+
+		if ((name != NULL) && !strcmp(name, gDecoders[i].name))
+		{
+			break;
+		}
+	}
+
+	return -1;
+}
+
+int lzvn_select_encoder(const char * name)
+{
+	int i;
+
+	for (i = 0; i < LZVN_ENCODERS; i++)
+	{
+		if ((name == NULL) || !strcmp(name, "auto") || !strcmp(name, gEncoders[i].name))
+		{
+			gEncoder = &gEncoders[i];
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+//==============================================================================
+
+static const lzvn_decoder_backend * lzvn_decoder(void)
+{
+	if ((gDecoder == NULL) && (lzvn_select_decoder(getenv("LZVN_DECODER")) != 0))
+	{
+		lzvn_select_decoder(NULL);
+	}
+
+	return gDecoder;
+}
+
+static const lzvn_encoder_backend * lzvn_encoder(void)
+{
+	if ((gEncoder == NULL) && (lzvn_select_encoder(getenv("LZVN_ENCODER")) != 0))
+	{
+		lzvn_select_encoder(NULL);
+	}
+
+	return gEncoder;
+}
+
+const char * lzvn_decoder_name(void)
+{
+	return lzvn_decoder()->name;
+}
+
+const char * lzvn_encoder_name(void)
+{
+	return lzvn_encoder()->name;
+}
+
+//==============================================================================
+// Names of the backends built into the library, NULL after the last one.
+
+const char * lzvn_decoder_backend_name(int index)
+{
+	return ((index >= 0) && (index < LZVN_DECODERS)) ? gDecoders[index].name : NULL;
+}
+
+const char * lzvn_encoder_backend_name(int index)
+{
+	return ((index >= 0) && (index < LZVN_ENCODERS)) ? gEncoders[index].name : NULL;
+}
+
+//==============================================================================
+
+size_t lzvn_decode(void * dst, size_t dst_size, const void * src, size_t src_size)
+{
+	return lzvn_decoder()->decode(dst, dst_size, src, src_size);
+}
+
+size_t lzvn_decode_adler32(void * dst, size_t dst_size, const void * src, size_t src_size, uint32_t * adler32)
+{
+	const lzvn_decoder_backend	*backend = lzvn_decoder();
+	size_t						size;
+
+	if (backend->decode_adler32 != NULL)
+	{
+		return backend->decode_adler32(dst, dst_size, src, src_size, adler32);
+	}
+
+	size = backend->decode(dst, dst_size, src, src_size);
+
+	if (size != 0)
+	{
+		*adler32 = lzvn_adler32(*adler32, (const uint8_t *)dst, size);
+	}
+
+	return size;
+}
+
+//==============================================================================
+// Output that doesn't fit (incompressible input, lzvn_encode.s needs more room
+// than lzvn_encode_bound() for it) is written as literals instead.
+
+size_t lzvn_encode(void * dst, size_t dst_size, const void * src, size_t src_size, void * work_space)
+{
+	size_t size = lzvn_encoder()->encode(dst, dst_size, src, src_size, work_space);
+
+	return (size == 0) ? lzvn_encode_stored(dst, dst_size, src, src_size) : size;
+}
+
+//==============================================================================
+// Decodes the src_size byte stream stored at the end of buffer (of buffer_size
+// bytes) into the start of the same buffer. Returns 0, without touching the
+// buffer, when buffer_size is less than dst_size plus the margin this stream
+// needs (see lzvn_decode_in_place_margin()), or when the stream is invalid.
+// With adler32 set, it is updated as by lzvn_decode_adler32().
+
+size_t lzvn_decode_in_place(void * buffer, size_t buffer_size, size_t dst_size, size_t src_size, uint32_t * adler32)
+{
+	const uint8_t	*src = (const uint8_t *)buffer + buffer_size - src_size;
+	size_t			margin;
+
+	if ((src_size > buffer_size) || (dst_size > buffer_size))
+	{
+		return 0;
+	}
+
+	margin = lzvn_decode_in_place_margin(src, src_size, dst_size);
+
+	if ((margin == (size_t)-1) || (margin > (buffer_size - dst_size)))
+	{
+		return 0;
+	}
+
+	return (adler32 != NULL) ? lzvn_decode_adler32(buffer, dst_size, src, src_size, adler32) : lzvn_decode(buffer, dst_size, src, src_size);
+}
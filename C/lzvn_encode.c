@@ -0,0 +1,1459 @@
+/*
+ * Created..: 16 October 2026
+ * Filename.: lzvn_encode.c
+ * Purpose..: Portable C LZVN encoder (block-parallel capable).
+ *
+ * The match finder hashes 3 to 6 bytes into a table of 1 to 16 candidates
+ * per bucket, sized by level (see lzvn_levels). At the default level the
+ * table takes the workspace of lzvn_encode.s (lzvn_encode_work_size), but
+ * matches are found, picked and emitted differently, so the output differs
+ * from that of the assembler version. Unlike the assembler version, the hash table can be preloaded
+ * with the 64 KB of input that precede the range being encoded. This makes it
+ * possible to encode independent segments of one large buffer on different
+ * threads, and to join the partial streams into one standard LZVN stream that
+ * the existing decoders accept unchanged.
+ *
+ * Opcodes (as implied by the caseTable in C/lzvn_decode.c):
+ *
+ *   sml_d  LLMMMDDD DDDDDDDD                  D < 0x600
+ *   med_d  101LLMMM DDDDDDMM DDDDDDDD         D < 0x4000
+ *   lrg_d  LLMMM111 DDDDDDDD DDDDDDDD         D < 0x10000
+ *   pre_d  LLMMM110                           D = previous distance, L > 0
+ *   sml_m  1111MMMM                           M = 1..15, previous distance
+ *   lrg_m  11110000 MMMMMMMM                  M = 16..271, previous distance
+ *   sml_l  1110LLLL                           L = 1..15 literals
+ *   lrg_l  11100000 LLLLLLLL                  L = 16..271 literals
+ *   eos    00000110 + 7 zero bytes
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LZVN_ENCODE_X86				1
+#else
+#define LZVN_ENCODE_X86				0
+#endif
+
+#include "../FastCompression.h"
+
+#define LZVN_ENCODE_HASH_BITS		14			// lzvn_encode_work_size() = 16K buckets
+#define LZVN_ENCODE_MIN_HASH_BITS	10			// 1K buckets for inputs up to 16 KB
+#define LZVN_ENCODE_MAX_WAYS		16
+#define LZVN_ENCODE_MAX_DISTANCE	0xffff
+#define LZVN_ENCODE_MIN_MATCH		3
+#define LZVN_ENCODE_MAX_LITERALS	271		// lrg_l: 0x10 + 0xff
+#define LZVN_ENCODE_MAX_MATCH		271		// lrg_m: 0x10 + 0xff
+
+#define LZVN_RUN_PERIOD				8			// matches at distance 1..8 are runs of a repeated pattern
+#define LZVN_RUN_LENGTH				64			// shortest run taken as it is
+#define LZVN_RUN_TAIL				16			// positions at the end of a run that are hashed
+
+#define LZVN_SEGMENT_SIZE			(4 << 20)
+#define LZVN_EOS_SIZE				8
+
+#define LZVN_STREAM_HISTORY			(LZVN_ENCODE_MAX_DISTANCE + 1)
+#define LZVN_STREAM_BLOCK			(1 << 20)
+#define LZVN_STREAM_WINDOW			(LZVN_STREAM_HISTORY + LZVN_STREAM_BLOCK)
+#define LZVN_STREAM_LOOKAHEAD		4096		// bytes kept back so matches are rarely cut short
+
+// Literal-only encoding of aSize bytes, used as fallback for incompressible segments.
+#define LZVN_LITERAL_BOUND(aSize)	((aSize) + 2 * (((aSize) + LZVN_ENCODE_MAX_LITERALS - 1) / LZVN_ENCODE_MAX_LITERALS))
+
+// Longest match that fits in the first opcode for L = 0, 1, 2 or 3 literals (see undefined opcodes in caseTable).
+static const int64_t lzvn_max_first_match[4] = { 10, 8, 6, 4 };
+
+typedef struct
+{
+	int32_t		hash_bytes;		// bytes hashed, 3..6
+	int32_t		hash_bits;		// largest table (log2 buckets), smaller for small inputs
+	int32_t		ways;			// candidates per bucket, 1, 2, 4, 8 or 16
+	int32_t		lazy;			// a better match at the next position may replace one found
+	int32_t		accel;			// after 1 << accel misses in a row, skip 1 more position (0 = off)
+	int32_t		optimal;		// chain entries checked per position by lzvn_encode_run_optimal(), 0 = greedy/lazy parse
+} lzvn_level;
+
+// Buckets are ways indices followed by ways values, so a table takes (buckets *
+// ways * 8) bytes, at most the 512 KB of lzvn_encode_work_size() at the default
+// level (lzvn_encode_c gets the workspace of the assembler version). Each level
+// is slower than the one before it and compresses better, measured with
+// lzvn_bench. The optimal parse uses 1-way buckets as heads of hash chains.
+static const lzvn_level lzvn_levels[LZVN_MAX_LEVEL + 1] =
+{
+	{ 0,  0,  0, 0, 0,   0 },
+	{ 6, 12,  1, 0, 3,   0 },
+	{ 5, 13,  2, 0, 5,   0 },
+	{ 4, 15,  2, 1, 0,   0 },
+	{ 5, 14,  4, 1, 0,   0 },
+	{ 4, 13,  8, 1, 0,   0 },
+	{ 4, 14,  8, 1, 0,   0 },
+	{ 3, 15,  8, 1, 0,   0 },
+	{ 3, 16, 16, 1, 0,   0 },
+	{ 3, 17,  1, 0, 0, 256 }
+};
+
+#define LZVN_OPTIMAL_BLOCK			(1 << 16)	// positions parsed at once
+#define LZVN_OPTIMAL_CHAIN			(LZVN_ENCODE_MAX_DISTANCE + 1)	// previous position with the same hash, by position & 0xffff
+#define LZVN_OPTIMAL_NICE			256			// longer matches are taken as they are
+
+// Distance classes for the optimal parse, by first opcode.
+enum
+{
+	LZVN_CLASS_PREVIOUS,		// pre_d, or sml_m/lrg_m only
+	LZVN_CLASS_SMALL,			// sml_d
+	LZVN_CLASS_MEDIUM,			// med_d
+	LZVN_CLASS_LARGE,			// lrg_d
+	LZVN_CLASSES
+};
+
+typedef struct
+{
+	uint32_t	price;			// cost + the bytes for L literals on their own
+	uint32_t	cost;			// bytes written before the L literals
+	int32_t		L;				// literals since the last match
+	int32_t		D;				// distance of the last match
+	int32_t		K;				// length of the match that ends here, 0 = literal
+} lzvn_node;
+
+typedef struct
+{
+	int64_t		m_begin;		// first byte of the match
+	int64_t		m_end;			// first byte after the match
+	int64_t		K;				// match length
+	int64_t		D;				// distance
+} lzvn_match;
+
+typedef struct
+{
+	const uint8_t	*src;				// all offsets below are relative to src
+	int64_t			src_begin;			// first byte that may be referenced
+	int64_t			src_end;			// end of the range being encoded
+	int64_t			src_literal;		// first byte not yet emitted
+	int64_t			src_current;		// next position to hash
+	int64_t			src_current_end;	// last position that can be hashed
+	uint8_t			*dst;
+	uint8_t			*dst_end;
+	int64_t			d_prev;				// distance of the last emitted match (0 = none)
+	lzvn_match		pending;			// match found, but not emitted yet
+	int64_t			pending_lazy;		// last position where a better match may replace it
+	int64_t			misses;				// positions without a match in a row (level.accel)
+	uint32_t		*table;				// see lzvn_levels
+	uint32_t		hash_mask;			// buckets in table - 1
+	lzvn_level		level;
+	int				avx2;				// compare 8 candidates at once
+} lzvn_encoder;
+
+//==============================================================================
+
+static inline uint32_t lzvn_load4(const uint8_t *p)
+{
+	uint32_t	value;
+
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static inline uint64_t lzvn_load8(const uint8_t *p)
+{
+	uint64_t	value;
+
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+//==============================================================================
+// Bucket of the hash_bytes bytes at aPosition. aValue holds the first 4 of them.
+
+static inline uint32_t lzvn_hash(const lzvn_encoder *state, int64_t aPosition, uint32_t aValue)
+{
+	uint64_t	value;
+	int64_t		i;
+
+	if (state->level.hash_bytes == 3)
+	{
+		return (((aValue & 0xffffff) * 0x1041) >> 12) & state->hash_mask;	// imull $0x1041 / andl -0xf0(%rbp)
+	}
+
+	if ((aPosition + 8) <= state->src_end)
+	{
+		value = lzvn_load8(state->src + aPosition);
+	}
+	else
+	{
+		// Near the end of the input, the bytes that aren't there hash as 0.
+		for (i = 0, value = 0; (aPosition + i) < state->src_end; i++)
+		{
+			value |= (uint64_t)state->src[aPosition + i] << (8 * i);
+		}
+	}
+
+	value <<= 64 - (8 * state->level.hash_bytes);
+
+	return (uint32_t)((value * 0x9e3779b97f4a7c15ull) >> 40) & state->hash_mask;
+}
+
+//==============================================================================
+// Bucket index bits for aSrcSize bytes of input, the same rule as the prologue
+// of _lzvn_encode_partial: one bucket per 16 bytes, at least 1K buckets, at
+// most 1 << aLevel->hash_bits. Small inputs get a table that fits in L1/L2
+// and is cheap to clear.
+
+static int lzvn_hash_bits(size_t aSrcSize, const lzvn_level *aLevel)
+{
+	int bits = LZVN_ENCODE_MIN_HASH_BITS;
+
+	while ((bits < aLevel->hash_bits) && (((size_t)1 << (bits + 4)) < aSrcSize))
+	{
+		bits++;
+	}
+
+	return bits;
+}
+
+static const lzvn_level * lzvn_get_level(int aLevel)
+{
+	if (aLevel < 1)
+	{
+		aLevel = 1;
+	}
+	else if (aLevel > LZVN_MAX_LEVEL)
+	{
+		aLevel = LZVN_MAX_LEVEL;
+	}
+
+	return &lzvn_levels[aLevel];
+}
+
+//==============================================================================
+// Workspace that lzvn_encode() needs for aSrcSize bytes, never more than
+// lzvn_encode_work_size().
+
+size_t lzvn_encode_work_size_for(size_t aSrcSize)
+{
+	return lzvn_encode_level_work_size(aSrcSize, LZVN_DEFAULT_LEVEL);
+}
+
+// Workspace that lzvn_encode_level() needs for aSrcSize bytes at aLevel.
+
+size_t lzvn_encode_level_work_size(size_t aSrcSize, int aLevel)
+{
+	const lzvn_level *level = lzvn_get_level(aLevel);
+
+	return ((size_t)1 << lzvn_hash_bits(aSrcSize, level)) * level->ways * 2 * sizeof(uint32_t);
+}
+
+//==============================================================================
+
+static void lzvn_set_level(lzvn_encoder *state, const lzvn_level *aLevel, size_t aSrcSize)
+{
+	state->level		= *aLevel;
+	state->hash_mask	= (1u << lzvn_hash_bits(aSrcSize, aLevel)) - 1;
+#if LZVN_ENCODE_X86
+	state->avx2			= (aLevel->ways >= 8) && __builtin_cpu_supports("avx2");
+#endif
+}
+
+//==============================================================================
+// Number of equal bytes at a and b, up to aMax.
+
+static inline int64_t lzvn_match_length(const uint8_t *a, const uint8_t *b, int64_t aMax)
+{
+	int64_t		length = 0;
+
+#if LZVN_ENCODE_X86
+	while ((length + 16) <= aMax)
+	{
+		uint32_t diff = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a + length)), _mm_loadu_si128((const __m128i *)(b + length)))) ^ 0xffff;
+
+		if (diff)
+		{
+			return length + __builtin_ctz(diff);
+		}
+
+		length += 16;
+	}
+#endif
+
+	while ((length + 8) <= aMax)
+	{
+		uint64_t diff = lzvn_load8(a + length) ^ lzvn_load8(b + length);
+
+		if (diff)
+		{
+			return length + (__builtin_ctzll(diff) >> 3);
+		}
+
+		length += 8;
+	}
+
+	while ((length < aMax) && (a[length] == b[length]))
+	{
+		length++;
+	}
+
+	return length;
+}
+
+//==============================================================================
+// Bytes saved by a match of length K at distance D (same metric as the asm).
+
+static inline int64_t lzvn_match_gain(int64_t K, int64_t D)
+{
+	return K - ((D < 0x600) ? 2 : 3);
+}
+
+//==============================================================================
+
+static void lzvn_table_init(lzvn_encoder *state)
+{
+	uint32_t	*bucket	= state->table;
+	int			ways	= state->level.ways;
+	uint32_t	i;
+
+	// Empty buckets point in front of src_begin, so they are never used.
+	for (i = 0; i <= state->hash_mask; i++, bucket += 2 * ways)
+	{
+		memset(bucket, 0xff, ways * sizeof(uint32_t));
+		memset(bucket + ways, 0, ways * sizeof(uint32_t));
+	}
+}
+
+static inline uint32_t * lzvn_table_bucket(lzvn_encoder *state, int64_t aPosition, uint32_t aValue)
+{
+	return state->table + (size_t)lzvn_hash(state, aPosition, aValue) * 2 * state->level.ways;
+}
+
+static inline void lzvn_table_insert(lzvn_encoder *state, uint32_t *aBucket, int64_t aPosition, uint32_t aValue)
+{
+	int ways = state->level.ways;
+
+	memmove(&aBucket[1], &aBucket[0], (ways - 1) * sizeof(uint32_t));
+	memmove(&aBucket[ways + 1], &aBucket[ways], (ways - 1) * sizeof(uint32_t));
+
+	aBucket[0]		= (uint32_t)aPosition;
+	aBucket[ways]	= aValue;
+}
+
+static inline void lzvn_table_add(lzvn_encoder *state, int64_t aPosition)
+{
+	uint32_t value = lzvn_load4(state->src + aPosition);
+
+	lzvn_table_insert(state, lzvn_table_bucket(state, aPosition, value), aPosition, value);
+}
+
+//==============================================================================
+// Bit i set = candidate i starts with the same bytes as aValue (under aMask).
+
+#if LZVN_ENCODE_X86
+__attribute__((target("avx2")))
+static uint32_t lzvn_candidates_avx2(const uint32_t *aValues, int aWays, uint32_t aValue, uint32_t aMask)
+{
+	__m256i		value	= _mm256_set1_epi32((int)(aValue & aMask));
+	__m256i		mask	= _mm256_set1_epi32((int)aMask);
+	uint32_t	result	= 0;
+	int			i;
+
+	for (i = 0; i < aWays; i += 8)
+	{
+		__m256i candidates = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)(aValues + i)), mask);
+
+		result |= (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(candidates, value))) << i;
+	}
+
+	return result;
+}
+#endif
+
+static inline uint32_t lzvn_candidates(const lzvn_encoder *state, const uint32_t *aValues, uint32_t aValue, uint32_t aMask)
+{
+	uint32_t	result	= 0;
+	int			i;
+
+#if LZVN_ENCODE_X86
+	if (state->avx2)
+	{
+		return lzvn_candidates_avx2(aValues, state->level.ways, aValue, aMask);
+	}
+#endif
+
+	for (i = 0; i < state->level.ways; i++)
+	{
+		result |= (uint32_t)(((aValues[i] ^ aValue) & aMask) == 0) << i;
+	}
+
+	return result;
+}
+
+//==============================================================================
+// Emit L literals from src_literal with sml_l/lrg_l opcodes. Returns 0 when
+// dst is full; src_literal is advanced for every opcode that was written.
+
+static int lzvn_emit_literals(lzvn_encoder *state, int64_t L)
+{
+	while (L > 0)
+	{
+		const uint8_t	*literals	= state->src + state->src_literal;
+		int64_t			count		= (L < LZVN_ENCODE_MAX_LITERALS) ? L : LZVN_ENCODE_MAX_LITERALS;
+
+		if ((state->dst + count + 2) > state->dst_end)
+		{
+			// Fill what is left of dst.
+			count = state->dst_end - state->dst - 2;
+
+			if (count <= 0)
+			{
+				return 0;
+			}
+		}
+
+		if (count < 16)
+		{
+			*state->dst++ = (uint8_t)(0xe0 + count);										// sml_l
+		}
+		else
+		{
+			*state->dst++ = 0xe0;															// lrg_l
+			*state->dst++ = (uint8_t)(count - 16);
+		}
+
+		memcpy(state->dst, literals, count);
+		state->dst += count;
+		state->src_literal += count;
+		L -= count;
+	}
+
+	return 1;
+}
+
+//==============================================================================
+// Emit the literals in front of aMatch followed by the match. Returns 0 when
+// dst is full; aMatch and src_literal are updated for what has been written,
+// so the next call continues where this one stopped.
+
+static int lzvn_emit_match(lzvn_encoder *state, lzvn_match *aMatch)
+{
+	int64_t		L = aMatch->m_begin - state->src_literal;
+	int64_t		K = aMatch->K;
+	int64_t		D = aMatch->D;
+	int64_t		M;
+
+	if (L > 3)
+	{
+		// Keep up to 3 literals for the distance opcode.
+		if (lzvn_emit_literals(state, L & ~3) == 0)
+		{
+			return 0;
+		}
+
+		L &= 3;
+	}
+
+	if ((D != state->d_prev) || (L != 0))
+	{
+		const uint8_t *literals = state->src + state->src_literal;
+
+		if ((state->dst + 3 + L) > state->dst_end)
+		{
+			return 0;
+		}
+
+		if (D == state->d_prev)
+		{
+			M = (K < lzvn_max_first_match[L]) ? K : lzvn_max_first_match[L];
+			*state->dst++ = (uint8_t)((L << 6) | ((M - 3) << 3) | 6);						// pre_d
+		}
+		else if (D < 0x600)
+		{
+			M = (K < lzvn_max_first_match[L]) ? K : lzvn_max_first_match[L];
+			*state->dst++ = (uint8_t)((L << 6) | ((M - 3) << 3) | (D >> 8));				// sml_d
+			*state->dst++ = (uint8_t)D;
+		}
+		else if (D < 0x4000)
+		{
+			M = (K < 34) ? K : 34;
+			*state->dst++ = (uint8_t)(0xa0 | (L << 3) | ((M - 3) >> 2));					// med_d
+			*state->dst++ = (uint8_t)((D << 2) | ((M - 3) & 3));
+			*state->dst++ = (uint8_t)(D >> 6);
+		}
+		else
+		{
+			M = (K < lzvn_max_first_match[L]) ? K : lzvn_max_first_match[L];
+			*state->dst++ = (uint8_t)((L << 6) | ((M - 3) << 3) | 7);						// lrg_d
+			*state->dst++ = (uint8_t)D;
+			*state->dst++ = (uint8_t)(D >> 8);
+		}
+
+		memcpy(state->dst, literals, L);
+		state->dst			+= L;
+		state->d_prev		= D;
+		aMatch->m_begin		+= M;
+		aMatch->K			-= M;
+		state->src_literal	= aMatch->m_begin;
+	}
+
+	// The rest of the match uses the previous distance.
+	while (aMatch->K > 0)
+	{
+		int64_t count = (aMatch->K < LZVN_ENCODE_MAX_MATCH) ? aMatch->K : LZVN_ENCODE_MAX_MATCH;
+
+		if ((state->dst + 2) > state->dst_end)
+		{
+			return 0;
+		}
+
+		if (count < 16)
+		{
+			*state->dst++ = (uint8_t)(0xf0 + count);										// sml_m
+		}
+		else
+		{
+			*state->dst++ = 0xf0;															// lrg_m
+			*state->dst++ = (uint8_t)(count - 16);
+		}
+
+		aMatch->m_begin		+= count;
+		aMatch->K			-= count;
+		state->src_literal	= aMatch->m_begin;
+	}
+
+	return 1;
+}
+
+//==============================================================================
+// Look for the best match at the current position, and insert the position.
+
+static lzvn_match lzvn_find_match(lzvn_encoder *state)
+{
+	const uint8_t	*src		= state->src;
+	int64_t			position	= state->src_current;
+	uint32_t		value		= lzvn_load4(src + position);
+	uint32_t		*bucket		= lzvn_table_bucket(state, position, value);
+	int32_t			indices[LZVN_ENCODE_MAX_WAYS];
+	uint32_t		candidates;
+	lzvn_match		best		= { 0, 0, 0, 0 };
+	int64_t			bestGain	= 0;
+	int				i;
+
+	// Candidates from before the insert.
+	memcpy(indices, bucket, state->level.ways * sizeof(int32_t));
+	candidates = lzvn_candidates(state, bucket + state->level.ways, value, (state->level.hash_bytes == 3) ? 0xffffff : 0xffffffff);
+
+	lzvn_table_insert(state, bucket, position, value);
+
+	for ( ; candidates; candidates &= candidates - 1)
+	{
+		int64_t candidate;
+		int64_t D;
+		int64_t K, back, gain;
+
+		i			= __builtin_ctz(candidates);
+		candidate	= indices[i];
+		D			= position - candidate;
+
+		if ((candidate < state->src_begin) || (D <= 0) || (D > LZVN_ENCODE_MAX_DISTANCE))
+		{
+			continue;
+		}
+
+		K = lzvn_match_length(src + position, src + candidate, state->src_end - position);
+
+		if (K < LZVN_ENCODE_MIN_MATCH)
+		{
+			continue;
+		}
+
+		// Extend backwards over bytes that have not been emitted yet.
+		back = 0;
+
+		while (((position - back) > state->src_literal) && ((candidate - back) > state->src_begin)
+			&& (src[position - back - 1] == src[candidate - back - 1]))
+		{
+			back++;
+		}
+
+		gain = lzvn_match_gain(K + back, D);
+
+		if ((gain > bestGain) || ((gain == bestGain) && (best.K != 0) && (D < best.D)))
+		{
+			best.m_begin	= position - back;
+			best.m_end		= position + K;
+			best.K			= K + back;
+			best.D			= D;
+			bestGain		= gain;
+		}
+	}
+
+	return best;
+}
+
+//==============================================================================
+// Encode positions src_current..src_current_end. Returns 0 when dst is full.
+
+static int lzvn_encode_run(lzvn_encoder *state)
+{
+	int64_t step;
+
+	for ( ; state->src_current < state->src_current_end; state->src_current += step)
+	{
+		lzvn_match incoming;
+
+		step = 1;
+
+		if (state->pending.K && (state->src_current >= state->pending.m_end))
+		{
+			if (lzvn_emit_match(state, &state->pending) == 0)
+			{
+				return 0;
+			}
+
+			state->pending.K = 0;
+		}
+
+		if ((state->src_current < state->src_literal) || (state->pending.K && (state->src_current > state->pending_lazy)))
+		{
+			// Already emitted or inside the pending match: only keep the hash table up to date.
+			lzvn_table_add(state, state->src_current);
+			continue;
+		}
+
+		incoming = lzvn_find_match(state);
+
+		if (incoming.K == 0)
+		{
+			// Acceleration (fast levels): after repeated misses, as in compressed
+			// data, step over positions without hashing them. They end up in one
+			// long literal run.
+			if (state->level.accel && (state->pending.K == 0))
+			{
+				step += state->misses++ >> state->level.accel;
+			}
+
+			continue;
+		}
+
+		state->misses = 0;
+
+		if ((state->pending.K == 0)
+			|| ((incoming.m_end > state->pending.m_end)
+			&& (lzvn_match_gain(incoming.K, incoming.D) > lzvn_match_gain(state->pending.K, state->pending.D))))
+		{
+			// Lazy matching: a better match one byte further replaces the pending one.
+			state->pending		= incoming;
+			state->pending_lazy	= state->src_current + state->level.lazy;
+		}
+
+		if ((state->pending.D <= LZVN_RUN_PERIOD) && (state->pending.K >= LZVN_RUN_LENGTH))
+		{
+			// Run of a repeated 1..8 byte pattern (zero fill, padding). Nothing
+			// longer can follow, so emit it now (as sml_m/lrg_m after the first
+			// opcode) and only hash its last bytes, for matches after the run.
+			int64_t end = state->pending.m_end;
+			int64_t position;
+
+			if (lzvn_emit_match(state, &state->pending) == 0)
+			{
+				return 0;
+			}
+
+			state->pending.K = 0;
+
+			for (position = end - LZVN_RUN_TAIL; position < end; position++)
+			{
+				if ((position > state->src_current) && (position < state->src_current_end))
+				{
+					lzvn_table_add(state, position);
+				}
+			}
+
+			state->src_current = end - step;
+		}
+	}
+
+	return 1;
+}
+
+//==============================================================================
+// Opcode bytes for n literals (sml_l/lrg_l) or n match bytes at the previous
+// distance (sml_m/lrg_m), in pieces of up to 271 bytes.
+
+static inline uint32_t lzvn_run_cost(int64_t n)
+{
+	int64_t rest = n % LZVN_ENCODE_MAX_LITERALS;
+
+	return (uint32_t)((n / LZVN_ENCODE_MAX_LITERALS) * 2) + ((rest == 0) ? 0 : (rest < 16) ? 1 : 2);
+}
+
+//==============================================================================
+// Bytes lzvn_emit_match() writes for L literals and a match of K bytes at
+// distance D, when the previous distance is aPrevious.
+
+static inline uint32_t lzvn_match_price(int64_t L, int64_t D, int64_t K, int64_t aPrevious)
+{
+	int64_t		Lin		= L & 3;
+	int64_t		M		= (K < lzvn_max_first_match[Lin]) ? K : lzvn_max_first_match[Lin];
+	uint32_t	price	= (uint32_t)(L + lzvn_run_cost(L & ~3));
+
+	if (D == aPrevious)
+	{
+		if (Lin == 0)
+		{
+			return price + lzvn_run_cost(K);
+		}
+
+		price += 1;
+	}
+	else if (D < 0x600)
+	{
+		price += 2;
+	}
+	else if (D < 0x4000)
+	{
+		price += 3;
+		M = (K < 34) ? K : 34;
+	}
+	else
+	{
+		price += 3;
+	}
+
+	return price + lzvn_run_cost(K - M);
+}
+
+static inline int lzvn_distance_class(int64_t D, int64_t aPrevious)
+{
+	return (D == aPrevious) ? LZVN_CLASS_PREVIOUS : (D < 0x600) ? LZVN_CLASS_SMALL : (D < 0x4000) ? LZVN_CLASS_MEDIUM : LZVN_CLASS_LARGE;
+}
+
+// A match end (L = 0) is priced with the sml_l that the next literal run has
+// to start with, so a match only replaces literals (and splits their run) when
+// it is cheaper including that opcode.
+
+static inline void lzvn_node_update(lzvn_node *aNode, uint32_t aCost, int64_t L, int64_t D, int64_t K)
+{
+	uint32_t price = aCost + (uint32_t)(L + lzvn_run_cost(L ? L : 1));
+
+	if (price < aNode->price)
+	{
+		aNode->price	= price;
+		aNode->cost		= aCost;
+		aNode->L		= (int32_t)L;
+		aNode->D		= (int32_t)D;
+		aNode->K		= (int32_t)K;
+	}
+}
+
+//==============================================================================
+// Hash chain insert for the optimal parse (the table has one way).
+
+static inline int64_t lzvn_chain_insert(lzvn_encoder *state, int32_t *aChain, int64_t aPosition)
+{
+	uint32_t	value	= lzvn_load4(state->src + aPosition);
+	uint32_t	*bucket	= lzvn_table_bucket(state, aPosition, value);
+	int64_t		head	= (int32_t)bucket[0];
+
+	aChain[aPosition & LZVN_ENCODE_MAX_DISTANCE] = (int32_t)head;
+	bucket[0] = (uint32_t)aPosition;
+	bucket[1] = value;
+
+	return head;
+}
+
+//==============================================================================
+// Optimal parse of src_current..src_current_end, in blocks of up to
+// LZVN_OPTIMAL_BLOCK positions. Every position is a node, reached either by a
+// literal or by a match, and the cheapest way to reach each node is kept with
+// the literals and previous distance it leaves, which is all the opcode cost
+// depends on (lzvn_match_price). Matches come from hash chains over the whole
+// 64 KB window. At every node the longest match per distance class is tried
+// at each length, since shorter lengths can be cheaper (a match
+// that fits in its first opcode) or leave a better start for the next match.
+// The result goes through lzvn_emit_match() like the greedy matches. Expects
+// an empty table (lzvn_table_init), the history is chained here.
+// Returns 0 when dst is full, -1 when memory ran out.
+
+static int lzvn_encode_run_optimal(lzvn_encoder *state)
+{
+	const uint8_t	*src		= state->src;
+	lzvn_node		*nodes		= malloc((LZVN_OPTIMAL_BLOCK + 1) * sizeof(lzvn_node));
+	int32_t			*path		= malloc((LZVN_OPTIMAL_BLOCK + 1) * sizeof(int32_t));
+	int32_t			*chain		= malloc(LZVN_OPTIMAL_CHAIN * sizeof(int32_t));
+	int64_t			position;
+	int				ok			= 1;
+
+	if ((nodes == NULL) || (path == NULL) || (chain == NULL))
+	{
+		free(nodes);
+		free(path);
+		free(chain);
+		return -1;
+	}
+
+	// Chain the history in front of src_current (the table is still empty).
+	for (position = state->src_begin; (position < state->src_current) && ((position + 4) <= state->src_end); position++)
+	{
+		lzvn_chain_insert(state, chain, position);
+	}
+
+	while (ok && (state->src_current < state->src_current_end))
+	{
+		int64_t		start	= state->src_current;
+		int64_t		n		= state->src_current_end - start;
+		int64_t		i, j, count;
+
+		if (n > LZVN_OPTIMAL_BLOCK)
+		{
+			n = LZVN_OPTIMAL_BLOCK;
+		}
+
+		for (i = 1; i <= n; i++)
+		{
+			nodes[i].price = UINT32_MAX;
+		}
+
+		// Literals left over from the previous block are still pending.
+		nodes[0].cost	= 0;
+		nodes[0].L		= (int32_t)(start - state->src_literal);
+		nodes[0].D		= (int32_t)state->d_prev;
+		nodes[0].K		= 0;
+
+		for (i = 0; i < n; )
+		{
+			int64_t		bestD[LZVN_CLASSES]	= { 0, 0, 0, 0 };
+			int64_t		bestK[LZVN_CLASSES]	= { 0, 0, 0, 0 };
+			int64_t		maxK		= n - i;
+			int64_t		longest		= 0;
+			int64_t		candidate, next;
+			int32_t		depth		= state->level.optimal;
+			uint32_t	value;
+			lzvn_node	node		= nodes[i];
+			int			c;
+
+			position	= start + i;
+			value		= lzvn_load4(src + position) & 0xffffff;
+			candidate	= lzvn_chain_insert(state, chain, position);
+
+			// The previous distance, then the chain (nearest first).
+			if ((node.D > 0) && ((position - node.D) >= state->src_begin))
+			{
+				bestD[LZVN_CLASS_PREVIOUS] = node.D;
+				bestK[LZVN_CLASS_PREVIOUS] = lzvn_match_length(src + position, src + position - node.D, maxK);
+			}
+
+			while ((candidate >= state->src_begin) && ((position - candidate) <= LZVN_ENCODE_MAX_DISTANCE) && (depth-- > 0))
+			{
+				int64_t D = position - candidate;
+				int64_t K;
+
+				c = lzvn_distance_class(D, node.D);
+
+				if ((c != LZVN_CLASS_PREVIOUS) && ((lzvn_load4(src + candidate) & 0xffffff) == value)
+					&& ((bestK[c] < LZVN_ENCODE_MIN_MATCH) || (src[candidate + bestK[c]] == src[position + bestK[c]]))
+					&& ((K = lzvn_match_length(src + position, src + candidate, maxK)) > bestK[c]))
+				{
+					bestD[c] = D;
+					bestK[c] = K;
+
+					if (K == maxK)
+					{
+						break;
+					}
+				}
+
+				next = chain[candidate & LZVN_ENCODE_MAX_DISTANCE];
+
+				if (next >= candidate)
+				{
+					break;
+				}
+
+				candidate = next;
+			}
+
+			lzvn_node_update(&nodes[i + 1], node.cost, node.L + 1, node.D, 0);
+
+			for (c = 0; c < LZVN_CLASSES; c++)
+			{
+				longest = (bestK[c] > bestK[longest]) ? c : longest;
+			}
+
+			if (bestK[longest] >= LZVN_OPTIMAL_NICE)
+			{
+				// Long match: take it, and only keep the table up to date inside it
+				// (only its end for runs, see lzvn_encode_run).
+				int64_t K = bestK[longest];
+
+				lzvn_node_update(&nodes[i + K], node.cost + lzvn_match_price(node.L, bestD[longest], K, node.D), 0, bestD[longest], K);
+
+				j = (bestD[longest] <= LZVN_RUN_PERIOD) ? (K - LZVN_RUN_TAIL) : 1;
+
+				for ( ; (j < K) && ((position + j) < state->src_current_end); j++)
+				{
+					lzvn_chain_insert(state, chain, position + j);
+				}
+
+				i += K;
+				continue;
+			}
+
+			for (c = 0; c < LZVN_CLASSES; c++)
+			{
+				int64_t K;
+
+				for (K = LZVN_ENCODE_MIN_MATCH; K <= bestK[c]; K++)
+				{
+					lzvn_node_update(&nodes[i + K], node.cost + lzvn_match_price(node.L, bestD[c], K, node.D), 0, bestD[c], K);
+				}
+			}
+
+			i++;
+		}
+
+		// Walk back from the end of the block, then emit the matches in order.
+		for (j = n, count = 0; j > 0; j -= (nodes[j].K ? nodes[j].K : 1))
+		{
+			if (nodes[j].K)
+			{
+				path[count++] = (int32_t)j;
+			}
+		}
+
+		while (ok && (count > 0))
+		{
+			lzvn_node	*end	= &nodes[path[--count]];
+			lzvn_match	match;
+
+			match.m_end		= start + path[count];
+			match.m_begin	= match.m_end - end->K;
+			match.K			= end->K;
+			match.D			= end->D;
+
+			ok = lzvn_emit_match(state, &match);
+		}
+
+		state->src_current = start + n;
+	}
+
+	free(nodes);
+	free(path);
+	free(chain);
+
+	return ok;
+}
+
+//==============================================================================
+// Emit the pending match and trailing literals (no end-of-stream opcode).
+
+static int lzvn_encode_flush(lzvn_encoder *state)
+{
+	if (state->pending.K)
+	{
+		if (lzvn_emit_match(state, &state->pending) == 0)
+		{
+			return 0;
+		}
+
+		state->pending.K = 0;
+	}
+
+	return lzvn_emit_literals(state, state->src_end - state->src_literal);
+}
+
+//==============================================================================
+// Encode aSrc[aBegin..aEnd) as a partial LZVN stream (no eos). Matches may
+// reference aSrc[aHistory..aBegin), which is preloaded into the hash table.
+// aTable holds lzvn_encode_level_work_size(aEnd - aHistory, level) bytes.
+// Returns the number of bytes written, or 0 when aDst is too small.
+
+static size_t lzvn_encode_segment(uint8_t *aDst, size_t aDstSize, const uint8_t *aSrc, int64_t aHistory, int64_t aBegin, int64_t aEnd, uint32_t *aTable, const lzvn_level *aLevel)
+{
+	lzvn_encoder	state;
+	int64_t			position;
+	int				result;
+
+	memset(&state, 0, sizeof(state));
+
+	// Offsets are relative to the history, so the 32-bit table indices never overflow.
+	state.src				= aSrc + aHistory;
+	state.src_begin			= 0;
+	state.src_end			= aEnd - aHistory;
+	state.src_literal		= aBegin - aHistory;
+	state.src_current		= aBegin - aHistory;
+	state.src_current_end	= ((aEnd - aBegin) >= 4) ? (state.src_end - 3) : state.src_current;
+	state.dst				= aDst;
+	state.dst_end			= aDst + aDstSize;
+	state.table				= aTable;
+
+	lzvn_set_level(&state, aLevel, (size_t)state.src_end);
+	lzvn_table_init(&state);
+
+	// The greedy parse is the fallback when the optimal one can't get memory.
+	// The optimal parse chains the history itself, the greedy one needs it in the table.
+	result = state.level.optimal ? lzvn_encode_run_optimal(&state) : -1;
+
+	if ((result < 0) && (state.src_current == aBegin - aHistory))
+	{
+		for (position = 0; (position < state.src_current) && ((position + 4) <= state.src_end); position++)
+		{
+			lzvn_table_add(&state, position);
+		}
+
+		result = lzvn_encode_run(&state);
+	}
+
+	if ((result <= 0) || (lzvn_encode_flush(&state) == 0))
+	{
+		return 0;
+	}
+
+	return (size_t)(state.dst - aDst);
+}
+
+//==============================================================================
+// Literal-only partial stream, for segments the match finder can't shrink.
+
+static size_t lzvn_encode_literals(uint8_t *aDst, size_t aDstSize, const uint8_t *aSrc, size_t aSrcSize)
+{
+	lzvn_encoder	state;
+
+	memset(&state, 0, sizeof(state));
+
+	state.src		= aSrc;
+	state.dst		= aDst;
+	state.dst_end	= aDst + aDstSize;
+
+	if (lzvn_emit_literals(&state, (int64_t)aSrcSize) == 0)
+	{
+		return 0;
+	}
+
+	return (size_t)(state.dst - aDst);
+}
+
+//==============================================================================
+// Single threaded encoder at level aLevel (1..LZVN_MAX_LEVEL), the hash table
+// lives in aWorkSpace (lzvn_encode_level_work_size(aSrcSize, aLevel) bytes).
+
+size_t lzvn_encode_level(void * aDst, size_t aDstSize, const void * aSrc, size_t aSrcSize, void * aWorkSpace, int aLevel)
+{
+	uint8_t	*dst	= (uint8_t *)aDst;
+	size_t	outSize	= 0;
+
+	if ((aSrcSize > 0x7fffffff) || (aWorkSpace == NULL))
+	{
+		return 0;
+	}
+
+	if ((aSrcSize > 0) && (aDstSize > LZVN_EOS_SIZE))
+	{
+		outSize = lzvn_encode_segment(dst, aDstSize - LZVN_EOS_SIZE, (const uint8_t *)aSrc, 0, 0, (int64_t)aSrcSize, (uint32_t *)aWorkSpace, lzvn_get_level(aLevel));
+
+		// Incompressible input still fits in lzvn_encode_bound(aSrcSize) as literals.
+		if (outSize == 0)
+		{
+			outSize = lzvn_encode_literals(dst, aDstSize - LZVN_EOS_SIZE, (const uint8_t *)aSrc, aSrcSize);
+		}
+
+		if (outSize == 0)
+		{
+			return 0;
+		}
+	}
+
+	if ((outSize + LZVN_EOS_SIZE) > aDstSize)
+	{
+		return 0;
+	}
+
+	memset(dst + outSize, 0, LZVN_EOS_SIZE);
+	dst[outSize] = 0x06;																	// eos
+
+	return outSize + LZVN_EOS_SIZE;
+}
+
+//==============================================================================
+// Literals only, for input the match finder can't shrink (the fallback of
+// lzvn_encode() when the assembler encoder runs out of room).
+
+size_t lzvn_encode_stored(void * aDst, size_t aDstSize, const void * aSrc, size_t aSrcSize)
+{
+	uint8_t	*dst	= (uint8_t *)aDst;
+	size_t	outSize	= 0;
+
+	if (aSrcSize > 0)
+	{
+		outSize = (aDstSize > LZVN_EOS_SIZE) ? lzvn_encode_literals(dst, aDstSize - LZVN_EOS_SIZE, (const uint8_t *)aSrc, aSrcSize) : 0;
+
+		if (outSize == 0)
+		{
+			return 0;
+		}
+	}
+
+	if ((outSize + LZVN_EOS_SIZE) > aDstSize)
+	{
+		return 0;
+	}
+
+	memset(dst + outSize, 0, LZVN_EOS_SIZE);
+	dst[outSize] = 0x06;																	// eos
+
+	return outSize + LZVN_EOS_SIZE;
+}
+
+//==============================================================================
+// Worst case output size of lzvn_encode(), lzvn_encode_level() and
+// lzvn_encode_parallel(): all literals, with a 2 byte lrg_l opcode for every
+// LZVN_ENCODE_MAX_LITERALS bytes (one more for each LZVN_SEGMENT_SIZE segment,
+// as the parallel encoder ends a literal run at every segment), plus the eos
+// opcode. Each of them writes literals when the match finder doesn't fit, so
+// with a buffer of this size they only fail when memory runs out.
+
+size_t lzvn_encode_bound(size_t aSrcSize)
+{
+	return LZVN_LITERAL_BOUND(aSrcSize) + 2 * ((aSrcSize + LZVN_SEGMENT_SIZE - 1) / LZVN_SEGMENT_SIZE) + LZVN_EOS_SIZE;
+}
+
+// Same interface as lzvn_encode.s (lzvn_encode_work_size_for(aSrcSize) bytes of workspace).
+
+size_t lzvn_encode_c(void * aDst, size_t aDstSize, const void * aSrc, size_t aSrcSize, void * aWorkSpace)
+{
+	return lzvn_encode_level(aDst, aDstSize, aSrc, aSrcSize, aWorkSpace, LZVN_DEFAULT_LEVEL);
+}
+
+//==============================================================================
+
+typedef struct
+{
+	const uint8_t	*src;
+	size_t			src_size;
+	int				level;
+	size_t			segment_count;
+	size_t			next_segment;			// shared, taken with __sync_fetch_and_add
+	uint8_t			**segment_dst;
+	size_t			*segment_dst_size;
+	int				failed;
+} lzvn_parallel_job;
+
+static void * lzvn_encode_worker(void *aJob)
+{
+	lzvn_parallel_job	*job	= (lzvn_parallel_job *)aJob;
+	uint32_t			*table	= malloc(lzvn_encode_level_work_size(LZVN_ENCODE_MAX_DISTANCE + LZVN_SEGMENT_SIZE, job->level));
+	size_t				segment;
+
+	if (table == NULL)
+	{
+		job->failed = 1;
+		return NULL;
+	}
+
+	while ((segment = __sync_fetch_and_add(&job->next_segment, 1)) < job->segment_count)
+	{
+		int64_t begin	= (int64_t)segment * LZVN_SEGMENT_SIZE;
+		int64_t end		= ((begin + LZVN_SEGMENT_SIZE) < (int64_t)job->src_size) ? (begin + LZVN_SEGMENT_SIZE) : (int64_t)job->src_size;
+		int64_t history	= (begin > LZVN_ENCODE_MAX_DISTANCE) ? (begin - LZVN_ENCODE_MAX_DISTANCE) : 0;
+		size_t	size	= LZVN_LITERAL_BOUND(end - begin);
+		uint8_t	*dst	= malloc(size);
+
+		if (dst == NULL)
+		{
+			job->failed = 1;
+			break;
+		}
+
+		job->segment_dst[segment]		= dst;
+		job->segment_dst_size[segment]	= lzvn_encode_segment(dst, size, job->src, history, begin, end, table, lzvn_get_level(job->level));
+
+		if (job->segment_dst_size[segment] == 0)
+		{
+			job->segment_dst_size[segment] = lzvn_encode_literals(dst, size, job->src + begin, end - begin);
+		}
+	}
+
+	free(table);
+
+	return NULL;
+}
+
+//==============================================================================
+// Split aSrc into LZVN_SEGMENT_SIZE segments, encode them on aThreads threads
+// and join the results into one LZVN stream with a single eos opcode.
+// Returns the number of bytes written to aDst, or 0 on failure (like lzvn_encode).
+
+size_t lzvn_encode_parallel(void * aDst, size_t aDstSize, const void * aSrc, size_t aSrcSize, int aThreads, int aLevel)
+{
+	lzvn_parallel_job	job;
+	pthread_t			*threads;
+	uint8_t				*dst		= (uint8_t *)aDst;
+	size_t				outSize		= 0;
+	size_t				segment;
+	int					created		= 1;
+	int					i;
+
+	memset(&job, 0, sizeof(job));
+
+	job.src				= (const uint8_t *)aSrc;
+	job.src_size		= aSrcSize;
+	job.level			= aLevel;
+	job.segment_count	= (aSrcSize + LZVN_SEGMENT_SIZE - 1) / LZVN_SEGMENT_SIZE;
+
+	if (aThreads < 1)
+	{
+		aThreads = 1;
+	}
+
+	if ((size_t)aThreads > job.segment_count)
+	{
+		aThreads = (job.segment_count) ? (int)job.segment_count : 1;
+	}
+
+	job.segment_dst			= calloc(job.segment_count + 1, sizeof(uint8_t *));
+	job.segment_dst_size	= calloc(job.segment_count + 1, sizeof(size_t));
+	threads					= calloc(aThreads, sizeof(pthread_t));
+
+	if ((job.segment_dst == NULL) || (job.segment_dst_size == NULL) || (threads == NULL))
+	{
+		job.failed = 1;
+	}
+	else
+	{
+		// The calling thread is worker number 0, the others share what is left if pthread_create fails.
+		while ((created < aThreads) && (pthread_create(&threads[created], NULL, lzvn_encode_worker, &job) == 0))
+		{
+			created++;
+		}
+
+		lzvn_encode_worker(&job);
+
+		for (i = 1; i < created; i++)
+		{
+			pthread_join(threads[i], NULL);
+		}
+	}
+
+	for (segment = 0; !job.failed && (segment < job.segment_count); segment++)
+	{
+		if ((job.segment_dst[segment] == NULL) || ((outSize + job.segment_dst_size[segment] + LZVN_EOS_SIZE) > aDstSize))
+		{
+			job.failed = 1;
+			break;
+		}
+
+		memcpy(dst + outSize, job.segment_dst[segment], job.segment_dst_size[segment]);
+		outSize += job.segment_dst_size[segment];
+	}
+
+	if (!job.failed && ((outSize + LZVN_EOS_SIZE) <= aDstSize))
+	{
+		memset(dst + outSize, 0, LZVN_EOS_SIZE);
+		dst[outSize] = 0x06;																// eos
+		outSize += LZVN_EOS_SIZE;
+	}
+	else
+	{
+		outSize = 0;
+	}
+
+	for (segment = 0; job.segment_dst && (segment < job.segment_count); segment++)
+	{
+		free(job.segment_dst[segment]);
+	}
+
+	free(job.segment_dst);
+	free(job.segment_dst_size);
+	free(threads);
+
+	return outSize;
+}
+
+
+//==============================================================================
+// Streaming encoder. Input is copied into a window of 64 KB history plus one
+// block, so callers can use small fixed buffers of any size. The hash table,
+// pending match and literals are kept in the context between calls.
+
+struct lzvn_encoder_stream
+{
+	lzvn_encoder	state;
+	uint8_t			*window;
+	int64_t			fill;				// bytes in window
+	int				eos;				// eos opcode written
+};
+
+lzvn_encoder_stream * lzvn_encoder_init(void)
+{
+	lzvn_encoder_stream	*stream = calloc(1, sizeof(lzvn_encoder_stream));
+
+	if (stream == NULL)
+	{
+		return NULL;
+	}
+
+	stream->window			= malloc(LZVN_STREAM_WINDOW);
+	stream->state.table		= malloc(lzvn_encode_level_work_size((size_t)-1, LZVN_DEFAULT_LEVEL));
+
+	if ((stream->window == NULL) || (stream->state.table == NULL))
+	{
+		lzvn_encoder_free(stream);
+		return NULL;
+	}
+
+	stream->state.src = stream->window;
+
+	// The total size isn't known, so the table is the largest one of the level.
+	lzvn_set_level(&stream->state, lzvn_get_level(LZVN_DEFAULT_LEVEL), (size_t)-1);
+	lzvn_table_init(&stream->state);
+
+	return stream;
+}
+
+void lzvn_encoder_free(lzvn_encoder_stream *aStream)
+{
+	if (aStream)
+	{
+		free(aStream->state.table);
+		free(aStream->window);
+		free(aStream);
+	}
+}
+
+//==============================================================================
+// Drop window bytes that can no longer be referenced. Literals that would be
+// dropped are emitted first. Returns 0 when dst is full.
+
+static int lzvn_stream_slide(lzvn_encoder_stream *aStream)
+{
+	lzvn_encoder	*state	= &aStream->state;
+	int64_t			keep	= state->src_current - LZVN_ENCODE_MAX_DISTANCE;
+	int64_t			target	= keep;
+	int64_t			index;
+	int				i;
+
+	if (state->pending.K && (state->pending.m_begin < target))
+	{
+		target = state->pending.m_begin;
+	}
+
+	if ((state->src_literal < target) && (lzvn_emit_literals(state, target - state->src_literal) == 0))
+	{
+		return 0;
+	}
+
+	if (state->src_literal < keep)
+	{
+		keep = state->src_literal;
+	}
+
+	if (keep <= 0)
+	{
+		return 1;
+	}
+
+	memmove(aStream->window, aStream->window + keep, aStream->fill - keep);
+
+	aStream->fill			-= keep;
+	state->src_end			-= keep;
+	state->src_literal		-= keep;
+	state->src_current		-= keep;
+	state->src_current_end	-= keep;
+	state->pending.m_begin	-= keep;
+	state->pending.m_end	-= keep;
+	state->pending_lazy		-= keep;
+
+	for (index = 0; index <= state->hash_mask; index++)
+	{
+		for (i = 0; i < state->level.ways; i++)
+		{
+			int32_t *slot = (int32_t *)&state->table[index * 2 * state->level.ways + i];
+
+			*slot = (*slot >= keep) ? (int32_t)(*slot - keep) : -1;
+		}
+	}
+
+	return 1;
+}
+
+//==============================================================================
+// Encode as much of aSrc as possible into aDst. *aSrcUsed is set to the number
+// of input bytes taken; input that wasn't taken must be passed again.
+
+size_t lzvn_encoder_feed(lzvn_encoder_stream *aStream, void * aDst, size_t aDstSize, const void * aSrc, size_t aSrcSize, size_t *aSrcUsed)
+{
+	lzvn_encoder	*state	= &aStream->state;
+	size_t			used	= 0;
+
+	state->dst		= (uint8_t *)aDst;
+	state->dst_end	= (uint8_t *)aDst + aDstSize;
+
+	for ( ; ; )
+	{
+		size_t count = LZVN_STREAM_WINDOW - aStream->fill;
+
+		if (count > (aSrcSize - used))
+		{
+			count = aSrcSize - used;
+		}
+
+		memcpy(aStream->window + aStream->fill, (const uint8_t *)aSrc + used, count);
+
+		aStream->fill			+= count;
+		used					+= count;
+		state->src_end			= aStream->fill;
+		state->src_current_end	= (aStream->fill > LZVN_STREAM_LOOKAHEAD) ? (aStream->fill - LZVN_STREAM_LOOKAHEAD) : 0;
+
+		if ((lzvn_encode_run(state) == 0) || (used == aSrcSize) || (lzvn_stream_slide(aStream) == 0))
+		{
+			break;
+		}
+	}
+
+	if (aSrcUsed)
+	{
+		*aSrcUsed = used;
+	}
+
+	return (size_t)(state->dst - (uint8_t *)aDst);
+}
+
+//==============================================================================
+// Encode all buffered input (no eos). Call until it returns 0. Matches in
+// later input can still reference the flushed data.
+
+size_t lzvn_encoder_flush(lzvn_encoder_stream *aStream, void * aDst, size_t aDstSize)
+{
+	lzvn_encoder	*state = &aStream->state;
+
+	state->dst				= (uint8_t *)aDst;
+	state->dst_end			= (uint8_t *)aDst + aDstSize;
+	state->src_end			= aStream->fill;
+	state->src_current_end	= (aStream->fill > 3) ? (aStream->fill - 3) : 0;
+
+	if (lzvn_encode_run(state))
+	{
+		lzvn_encode_flush(state);
+	}
+
+	return (size_t)(state->dst - (uint8_t *)aDst);
+}
+
+//==============================================================================
+// Flush and terminate the stream with the eos opcode. Call until it returns 0.
+
+size_t lzvn_encoder_finish(lzvn_encoder_stream *aStream, void * aDst, size_t aDstSize)
+{
+	lzvn_encoder	*state	= &aStream->state;
+	size_t			outSize	= lzvn_encoder_flush(aStream, aDst, aDstSize);
+
+	if (!aStream->eos && (state->pending.K == 0) && (state->src_literal == aStream->fill)
+		&& ((outSize + LZVN_EOS_SIZE) <= aDstSize))
+	{
+		memset((uint8_t *)aDst + outSize, 0, LZVN_EOS_SIZE);
+		((uint8_t *)aDst)[outSize] = 0x06;												// eos
+		outSize += LZVN_EOS_SIZE;
+		aStream->eos = 1;
+	}
+
+	return outSize;
+}
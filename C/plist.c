@@ -0,0 +1,976 @@
+/*
+ * Created..: 17 October 2026
+ * Filename.: plist.c
+ * Purpose..: Zero-copy parser for the XML plist dialect of __PRELINK_INFO.
+ *
+ * __PRELINK_INFO holds the _PrelinkInfoDictionary as serialized by the kernel
+ * and kext_tools, and read back by OSUnserializeXML()/IOCFUnserialize(): no
+ * header, <integer size="64">0x...</integer>, <set>, and an object that occurs
+ * more than once is written once with ID="n" and after that as <type IDREF="n"/>.
+ *
+ * Instead of building the whole tree, the parser walks the tags in place.
+ * plist_dict_get() and plist_next() only skip over what is in front of the
+ * value asked for, plist_parse() calls back for every value. ID attributes
+ * are indexed when the first IDREF is resolved, and only up to that IDREF.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "plist.h"
+
+#define PLIST_TAG_OPEN		0
+#define PLIST_TAG_CLOSE		1
+#define PLIST_TAG_EMPTY		2
+
+#define PLIST_MAX_ID		(1 << 24)
+
+typedef struct plist_tag
+{
+	const char			*start;		// '<'
+	const char			*end;		// past '>'
+	const char			*name;
+	size_t				name_size;
+	int					kind;
+	long				id;			// ID="n", or -1
+	long				idref;		// IDREF="n", or -1
+} plist_tag;
+
+static const struct
+{
+	const char			*name;
+	int					type;
+} plist_types[] =
+{
+	{ "dict",		PLIST_DICT },
+	{ "array",		PLIST_ARRAY },
+	{ "set",		PLIST_SET },
+	{ "key",		PLIST_KEY },
+	{ "string",		PLIST_STRING },
+	{ "integer",	PLIST_INTEGER },
+	{ "data",		PLIST_DATA },
+	{ "true",		PLIST_TRUE },
+	{ "false",		PLIST_FALSE },
+};
+
+#define PLIST_IS_SPACE(c)		(((c) == ' ') || ((c) == '\t') || ((c) == '\n') || ((c) == '\r'))
+#define PLIST_IS_CONTAINER(t)	(((t) == PLIST_DICT) || ((t) == PLIST_ARRAY) || ((t) == PLIST_SET))
+
+//==============================================================================
+
+static const char * plist_find(const char * p, const char * end, const char * string, size_t size)
+{
+	while ((size_t)(end - p) >= size)
+	{
+		if ((p = memchr(p, string[0], (end - p) - size + 1)) == NULL)
+		{
+			return NULL;
+		}
+
+		if (!memcmp(p, string, size))
+		{
+			return p;
+		}
+
+		p++;
+	}
+
+	return NULL;
+}
+
+//==============================================================================
+// Skips white space, comments, <?xml ...?> and <!DOCTYPE ...>.
+
+static const char * plist_skip(const char * p, const char * end)
+{
+	for ( ; ; )
+	{
+		while ((p < end) && PLIST_IS_SPACE(*p))
+		{
+			p++;
+		}
+
+		if (((end - p) >= 4) && !memcmp(p, "<!--", 4))
+		{
+			p = plist_find(p + 4, end, "-->", 3);
+			p = p ? p + 3 : end;
+		}
+		else if (((end - p) >= 2) && (p[0] == '<') && ((p[1] == '?') || (p[1] == '!')))
+		{
+			p = memchr(p, '>', end - p);
+			p = p ? p + 1 : end;
+		}
+		else
+		{
+			return p;
+		}
+	}
+}
+
+//==============================================================================
+
+static long plist_decimal(const char * p, const char * end)
+{
+	long	n = 0;
+
+	if (p == end)
+	{
+		return -1;
+	}
+
+	for ( ; p < end; p++)
+	{
+		if ((*p < '0') || (*p > '9') || (n >= PLIST_MAX_ID))
+		{
+			return -1;
+		}
+
+		n = (n * 10) + (*p - '0');
+	}
+
+	return n;
+}
+
+//==============================================================================
+// Reads the tag at p, which must be a '<'. Returns 0, or -1 on invalid XML.
+
+static int plist_read_tag(const char * p, const char * end, plist_tag * tag)
+{
+	tag->start	= p;
+	tag->kind	= PLIST_TAG_OPEN;
+	tag->id		= -1;
+	tag->idref	= -1;
+
+	if ((p >= end) || (*p++ != '<'))
+	{
+		return -1;
+	}
+
+	if ((p < end) && (*p == '/'))
+	{
+		tag->kind = PLIST_TAG_CLOSE;
+		p++;
+	}
+
+	tag->name = p;
+
+	while ((p < end) && !PLIST_IS_SPACE(*p) && (*p != '/') && (*p != '>'))
+	{
+		p++;
+	}
+
+	tag->name_size = p - tag->name;
+
+	for ( ; ; )
+	{
+		const char	*attribute;
+		const char	*value;
+		size_t		size;
+
+		while ((p < end) && PLIST_IS_SPACE(*p))
+		{
+			p++;
+		}
+
+		if (p >= end)
+		{
+			return -1;
+		}
+
+		if (*p == '>')
+		{
+			p++;
+			break;
+		}
+
+		if (*p == '/')
+		{
+			if (((p + 1) >= end) || (p[1] != '>') || (tag->kind == PLIST_TAG_CLOSE))
+			{
+				return -1;
+			}
+
+			tag->kind = PLIST_TAG_EMPTY;
+			p += 2;
+			break;
+		}
+
+		// name="value"
+		attribute = p;
+
+		while ((p < end) && !PLIST_IS_SPACE(*p) && (*p != '=') && (*p != '/') && (*p != '>'))
+		{
+			p++;
+		}
+
+		size = p - attribute;
+
+		while ((p < end) && PLIST_IS_SPACE(*p))
+		{
+			p++;
+		}
+
+		if ((size == 0) || (p >= end) || (*p++ != '='))
+		{
+			return -1;
+		}
+
+		while ((p < end) && PLIST_IS_SPACE(*p))
+		{
+			p++;
+		}
+
+		if ((p >= end) || ((*p != '"') && (*p != '\'')))
+		{
+			return -1;
+		}
+
+		value = p + 1;
+
+		if ((p = memchr(value, *p, end - value)) == NULL)
+		{
+			return -1;
+		}
+
+		if ((size == 2) && !memcmp(attribute, "ID", 2))
+		{
+			tag->id = plist_decimal(value, p);
+		}
+		else if ((size == 5) && !memcmp(attribute, "IDREF", 5))
+		{
+			if ((tag->idref = plist_decimal(value, p)) < 0)
+			{
+				return -1;
+			}
+		}
+
+		p++;
+	}
+
+	tag->end = p;
+
+	return (tag->name_size != 0) ? 0 : -1;
+}
+
+//==============================================================================
+
+static int plist_type(const plist_tag * tag)
+{
+	size_t	i;
+
+	for (i = 0; i < (sizeof(plist_types) / sizeof(plist_types[0])); i++)
+	{
+		if ((strlen(plist_types[i].name) == tag->name_size) && !memcmp(plist_types[i].name, tag->name, tag->name_size))
+		{
+			return plist_types[i].type;
+		}
+	}
+
+	return PLIST_INVALID;
+}
+
+//==============================================================================
+// Records the elements with an ID attribute from parser->indexed up to upto.
+
+static int plist_index(plist_parser * parser, const char * upto)
+{
+	const char	*p = parser->indexed;
+	const char	*q;
+	plist_tag	tag;
+
+	while ((p < upto) && ((p = memchr(p, '<', upto - p)) != NULL))
+	{
+		if ((q = plist_skip(p, parser->xml_end)) != p)
+		{
+			p = q;
+			continue;
+		}
+
+		if (plist_read_tag(p, parser->xml_end, &tag) != 0)
+		{
+			return -1;
+		}
+
+		if (tag.id >= 0)
+		{
+			if ((size_t)tag.id >= parser->id_space)
+			{
+				size_t		space	= (parser->id_space > 0) ? parser->id_space : 256;
+				const char	**ids;
+
+				while (space <= (size_t)tag.id)
+				{
+					space *= 2;
+				}
+
+				if ((ids = realloc(parser->ids, space * sizeof(const char *))) == NULL)
+				{
+					return -1;
+				}
+
+				memset(ids + parser->id_space, 0, (space - parser->id_space) * sizeof(const char *));
+
+				parser->ids			= ids;
+				parser->id_space	= space;
+			}
+
+			parser->ids[tag.id] = tag.start;
+
+			if ((size_t)tag.id >= parser->id_count)
+			{
+				parser->id_count = tag.id + 1;
+			}
+		}
+
+		p = tag.end;
+	}
+
+	if ((p == NULL) || (p < upto))
+	{
+		p = upto;
+	}
+
+	if (p > parser->indexed)
+	{
+		parser->indexed = p;
+	}
+
+	return 0;
+}
+
+//==============================================================================
+// The element an IDREF refers to, which is always in front of the reference.
+
+static const char * plist_resolve(plist_parser * parser, const plist_tag * tag)
+{
+	size_t	id = (size_t)tag->idref;
+
+	if (((id >= parser->id_count) || (parser->ids[id] == NULL))
+		&& (plist_index(parser, tag->start) != 0)
+		)
+	{
+		return NULL;
+	}
+
+	if ((id >= parser->id_count) || (parser->ids[id] == NULL) || (parser->ids[id] >= tag->start))
+	{
+		return NULL;
+	}
+
+	return parser->ids[id];
+}
+
+//==============================================================================
+// Parses the element at (or after white space at) p, and sets *next past it.
+// Containers are only skipped: value->data..size are their children.
+
+static int plist_element(plist_parser * parser, const char * p, const char * end, plist_value * value, const char ** next)
+{
+	plist_tag	tag;
+	plist_tag	close;
+	const char	*q;
+	int			depth;
+
+	p = plist_skip(p, end);
+
+	if ((plist_read_tag(p, end, &tag) != 0) || (tag.kind == PLIST_TAG_CLOSE)
+		|| ((value->type = plist_type(&tag)) == PLIST_INVALID)
+		)
+	{
+		return -1;
+	}
+
+	value->data	= tag.end;
+	value->size	= 0;
+	*next		= tag.end;
+
+	if (tag.idref >= 0)
+	{
+		const char	*target = plist_resolve(parser, &tag);
+		const char	*ignored;
+
+		if ((target == NULL) || (tag.kind != PLIST_TAG_EMPTY))
+		{
+			return -1;
+		}
+
+		return plist_element(parser, target, parser->xml_end, value, &ignored);
+	}
+
+	if (tag.kind == PLIST_TAG_EMPTY)
+	{
+		return 0;
+	}
+
+	if (!PLIST_IS_CONTAINER(value->type))
+	{
+		// Scalars can't contain a '<', the next one is the closing tag.
+		if (((q = memchr(tag.end, '<', end - tag.end)) == NULL)
+			|| (plist_read_tag(q, end, &close) != 0)
+			)
+		{
+			return -1;
+		}
+	}
+	else
+	{
+		// Skip to the matching closing tag.
+		for (depth = 1, q = tag.end; depth > 0; q = close.end)
+		{
+			if ((q = memchr(q, '<', end - q)) == NULL)
+			{
+				return -1;
+			}
+
+			// A comment.
+			if ((p = plist_skip(q, end)) != q)
+			{
+				close.end = p;
+				close.kind = PLIST_TAG_EMPTY;
+				continue;
+			}
+
+			if (plist_read_tag(q, end, &close) != 0)
+			{
+				return -1;
+			}
+
+			if (close.kind == PLIST_TAG_OPEN)
+			{
+				depth++;
+			}
+			else if (close.kind == PLIST_TAG_CLOSE)
+			{
+				depth--;
+			}
+		}
+	}
+
+	if ((close.kind != PLIST_TAG_CLOSE) || (close.name_size != tag.name_size)
+		|| memcmp(close.name, tag.name, tag.name_size)
+		)
+	{
+		return -1;
+	}
+
+	value->size	= close.start - tag.end;
+	*next		= close.end;
+
+	return 0;
+}
+
+//==============================================================================
+
+int plist_init(plist_parser * parser, const char * xml, size_t size)
+{
+	memset(parser, 0, sizeof(plist_parser));
+
+	parser->xml		= xml;
+	parser->xml_end	= xml + size;
+	parser->indexed	= xml;
+
+	return 0;
+}
+
+//==============================================================================
+
+void plist_free(plist_parser * parser)
+{
+	free(parser->ids);
+
+	parser->ids			= NULL;
+	parser->id_count	= 0;
+	parser->id_space	= 0;
+}
+
+//==============================================================================
+
+int plist_index_all(plist_parser * parser)
+{
+	return plist_index(parser, parser->xml_end);
+}
+
+//==============================================================================
+// The top level value, inside <plist> if there is one.
+
+int plist_root(plist_parser * parser, plist_value * value)
+{
+	const char	*p = plist_skip(parser->xml, parser->xml_end);
+	const char	*next;
+	plist_tag	tag;
+
+	if ((plist_read_tag(p, parser->xml_end, &tag) == 0) && (tag.kind == PLIST_TAG_OPEN)
+		&& (tag.name_size == 5) && !memcmp(tag.name, "plist", 5)
+		)
+	{
+		p = tag.end;
+	}
+
+	return (plist_element(parser, p, parser->xml_end, value, &next) == 0) ? 1 : -1;
+}
+
+//==============================================================================
+// Iterates over a dict, array or set. *cursor starts out NULL. For a dict key
+// is set to the <key>, it can be NULL for an array or set.
+
+int plist_next(plist_parser * parser, const plist_value * container, const char ** cursor, plist_value * key, plist_value * value)
+{
+	const char	*end	= container->data + container->size;
+	const char	*p		= (*cursor != NULL) ? *cursor : container->data;
+	plist_value	name;
+
+	if (!PLIST_IS_CONTAINER(container->type))
+	{
+		return -1;
+	}
+
+	if ((p = plist_skip(p, end)) >= end)
+	{
+		return 0;
+	}
+
+	if (container->type == PLIST_DICT)
+	{
+		if ((plist_element(parser, p, end, &name, &p) != 0) || (name.type != PLIST_KEY))
+		{
+			return -1;
+		}
+	}
+	else
+	{
+		memset(&name, 0, sizeof(plist_value));
+	}
+
+	if (plist_element(parser, p, end, value, cursor) != 0)
+	{
+		return -1;
+	}
+
+	if (key != NULL)
+	{
+		*key = name;
+	}
+
+	return 1;
+}
+
+//==============================================================================
+
+int plist_dict_get(plist_parser * parser, const plist_value * dict, const char * key, plist_value * value)
+{
+	const char	*cursor = NULL;
+	plist_value	name;
+	int			status;
+
+	if (dict->type != PLIST_DICT)
+	{
+		return -1;
+	}
+
+	while ((status = plist_next(parser, dict, &cursor, &name, value)) == 1)
+	{
+		if (plist_string_equal(&name, key))
+		{
+			return 1;
+		}
+	}
+
+	return status;
+}
+
+//==============================================================================
+
+static int plist_walk(plist_parser * parser, const plist_value * key, const plist_value * value, const plist_callbacks * callbacks, void * context, int depth)
+{
+	const char	*cursor = NULL;
+	plist_value	name;
+	plist_value	member;
+	int			status;
+
+	if (!PLIST_IS_CONTAINER(value->type))
+	{
+		return callbacks->scalar ? callbacks->scalar(context, key, value) : 0;
+	}
+
+	if (depth >= PLIST_MAX_DEPTH)
+	{
+		return -1;
+	}
+
+	if (callbacks->begin && ((status = callbacks->begin(context, key, value)) != 0))
+	{
+		return status;
+	}
+
+	while ((status = plist_next(parser, value, &cursor, &name, &member)) == 1)
+	{
+		if ((status = plist_walk(parser, (value->type == PLIST_DICT) ? &name : NULL, &member, callbacks, context, depth + 1)) != 0)
+		{
+			return status;
+		}
+	}
+
+	if (status < 0)
+	{
+		return -1;
+	}
+
+	return callbacks->end ? callbacks->end(context, value) : 0;
+}
+
+//==============================================================================
+// Calls back for value and everything in it, in document order, with IDREFs
+// expanded. Returns 0 when done, -1 on invalid XML, or what a callback returned.
+
+int plist_parse(plist_parser * parser, const plist_value * value, const plist_callbacks * callbacks, void * context)
+{
+	return plist_walk(parser, NULL, value, callbacks, context, 0);
+}
+
+//==============================================================================
+// Decimal, or hexadecimal with 0x (as written for <integer size="64">).
+// Returns 1 on success, 0 otherwise.
+
+int plist_integer(const plist_value * value, uint64_t * number)
+{
+	const char	*p		= value->data;
+	const char	*end	= value->data + value->size;
+	uint64_t	n		= 0;
+	int			base	= 10;
+	int			negative = 0;
+	int			digits	= 0;
+
+	if (value->type != PLIST_INTEGER)
+	{
+		return 0;
+	}
+
+	while ((p < end) && PLIST_IS_SPACE(*p))
+	{
+		p++;
+	}
+
+	while ((end > p) && PLIST_IS_SPACE(end[-1]))
+	{
+		end--;
+	}
+
+	if ((p < end) && (*p == '-'))
+	{
+		negative = 1;
+		p++;
+	}
+
+	if (((end - p) > 2) && (p[0] == '0') && ((p[1] == 'x') || (p[1] == 'X')))
+	{
+		base = 16;
+		p += 2;
+	}
+
+	for ( ; p < end; p++, digits++)
+	{
+		int	digit;
+
+		if ((*p >= '0') && (*p <= '9'))
+		{
+			digit = *p - '0';
+		}
+		else if ((base == 16) && ((*p | 0x20) >= 'a') && ((*p | 0x20) <= 'f'))
+		{
+			digit = (*p | 0x20) - 'a' + 10;
+		}
+		else
+		{
+			return 0;
+		}
+
+		n = (n * base) + digit;
+	}
+
+	*number = negative ? (uint64_t)(-(int64_t)n) : n;
+
+	return (digits > 0);
+}
+
+//==============================================================================
+// Decodes the character (or entity) at *p into out, returns its length.
+
+static size_t plist_char(const char ** p, const char * end, char out[4])
+{
+	static const struct
+	{
+		const char	*name;
+		char		c;
+	} entities[] =
+	{
+		{ "lt", '<' }, { "gt", '>' }, { "amp", '&' }, { "quot", '"' }, { "apos", '\'' }
+	};
+
+	const char	*s = *p;
+	const char	*semicolon;
+	size_t		i;
+
+	if ((*s == '&') && ((semicolon = memchr(s, ';', ((end - s) < 12) ? (end - s) : 12)) != NULL))
+	{
+		const char	*name	= s + 1;
+		size_t		size	= semicolon - name;
+		uint32_t	code	= 0;
+
+		for (i = 0; i < (sizeof(entities) / sizeof(entities[0])); i++)
+		{
+			if ((strlen(entities[i].name) == size) && !memcmp(entities[i].name, name, size))
+			{
+				out[0]	= entities[i].c;
+				*p		= semicolon + 1;
+				return 1;
+			}
+		}
+
+		if ((size >= 2) && (name[0] == '#'))
+		{
+			int	hex = ((name[1] | 0x20) == 'x');
+
+			for (i = hex ? 2 : 1; i < size; i++)
+			{
+				char	c = name[i] | 0x20;
+
+				if ((c >= '0') && (c <= '9'))
+				{
+					code = (code * (hex ? 16 : 10)) + (c - '0');
+				}
+				else if (hex && (c >= 'a') && (c <= 'f'))
+				{
+					code = (code * 16) + (c - 'a' + 10);
+				}
+				else
+				{
+					break;
+				}
+			}
+
+			if ((i == size) && (size > (hex ? 2U : 1U)) && (code < 0x110000))
+			{
+				*p = semicolon + 1;
+
+				// UTF-8
+				if (code < 0x80)
+				{
+					out[0] = code;
+					return 1;
+				}
+				else if (code < 0x800)
+				{
+					out[0] = 0xc0 | (code >> 6);
+					out[1] = 0x80 | (code & 0x3f);
+					return 2;
+				}
+				else if (code < 0x10000)
+				{
+					out[0] = 0xe0 | (code >> 12);
+					out[1] = 0x80 | ((code >> 6) & 0x3f);
+					out[2] = 0x80 | (code & 0x3f);
+					return 3;
+				}
+
+				out[0] = 0xf0 | (code >> 18);
+				out[1] = 0x80 | ((code >> 12) & 0x3f);
+				out[2] = 0x80 | ((code >> 6) & 0x3f);
+				out[3] = 0x80 | (code & 0x3f);
+				return 4;
+			}
+		}
+	}
+
+	out[0]	= *s;
+	*p		= s + 1;
+
+	return 1;
+}
+
+//==============================================================================
+// Copies a <string> or <key> with the entities decoded, truncated to fit in
+// size bytes with a terminating zero. Returns the full (decoded) length.
+
+size_t plist_string(const plist_value * value, char * buffer, size_t size)
+{
+	const char	*p		= value->data;
+	const char	*end	= value->data + value->size;
+	size_t		length	= 0;
+	char		c[4];
+	size_t		i, n;
+
+	while (p < end)
+	{
+		for (i = 0, n = plist_char(&p, end, c); i < n; i++, length++)
+		{
+			if ((length + 1) < size)
+			{
+				buffer[length] = c[i];
+			}
+		}
+	}
+
+	if (size > 0)
+	{
+		buffer[(length < size) ? length : (size - 1)] = '\0';
+	}
+
+	return length;
+}
+
+//==============================================================================
+
+int plist_string_equal(const plist_value * value, const char * string)
+{
+	const char	*p		= value->data;
+	const char	*end	= value->data + value->size;
+	char		c[4];
+	size_t		i, n;
+
+	while (p < end)
+	{
+		for (i = 0, n = plist_char(&p, end, c); i < n; i++)
+		{
+			if (*string++ != c[i])
+			{
+				return 0;
+			}
+		}
+	}
+
+	return (*string == '\0');
+}
+
+//==============================================================================
+// plist_write() is plist_parse() with these callbacks.
+
+typedef struct plist_writer
+{
+	FILE				*fp;
+	int					depth;
+} plist_writer;
+
+static void plist_write_indent(plist_writer * writer)
+{
+	int	i;
+
+	for (i = 0; i < writer->depth; i++)
+	{
+		fputc('\t', writer->fp);
+	}
+}
+
+// Indents, after the <key> line of a dict member.
+static void plist_write_key(plist_writer * writer, const plist_value * key)
+{
+	if (key != NULL)
+	{
+		plist_write_indent(writer);
+		fprintf(writer->fp, "<key>%.*s</key>\n", (int)key->size, key->data);
+	}
+
+	plist_write_indent(writer);
+}
+
+static int plist_write_begin(void * context, const plist_value * key, const plist_value * value)
+{
+	plist_writer	*writer = (plist_writer *)context;
+	const char		*name	= (value->type == PLIST_DICT) ? "dict" : "array";
+
+	plist_write_key(writer, key);
+
+	if (plist_skip(value->data, value->data + value->size) == (value->data + value->size))
+	{
+		fprintf(writer->fp, "<%s/>\n", name);
+	}
+	else
+	{
+		fprintf(writer->fp, "<%s>\n", name);
+	}
+
+	writer->depth++;
+
+	return 0;
+}
+
+static int plist_write_end(void * context, const plist_value * value)
+{
+	plist_writer	*writer = (plist_writer *)context;
+
+	writer->depth--;
+
+	if (plist_skip(value->data, value->data + value->size) != (value->data + value->size))
+	{
+		plist_write_key(writer, NULL);
+		fprintf(writer->fp, "</%s>\n", (value->type == PLIST_DICT) ? "dict" : "array");
+	}
+
+	return 0;
+}
+
+static int plist_write_scalar(void * context, const plist_value * key, const plist_value * value)
+{
+	plist_writer	*writer = (plist_writer *)context;
+	const char		*p		= value->data;
+	const char		*end	= value->data + value->size;
+	uint64_t		number	= 0;
+
+	plist_write_key(writer, key);
+
+	switch (value->type)
+	{
+		case PLIST_INTEGER:
+			// CFNumber writes the signed value.
+			plist_integer(value, &number);
+			fprintf(writer->fp, "<integer>%lld</integer>\n", (long long)number);
+			break;
+
+		case PLIST_DATA:
+			while ((p < end) && PLIST_IS_SPACE(*p))
+			{
+				p++;
+			}
+
+			while ((end > p) && PLIST_IS_SPACE(end[-1]))
+			{
+				end--;
+			}
+
+			fprintf(writer->fp, "<data>%.*s</data>\n", (int)(end - p), p);
+			break;
+
+		case PLIST_TRUE:
+			fprintf(writer->fp, "<true/>\n");
+			break;
+
+		case PLIST_FALSE:
+			fprintf(writer->fp, "<false/>\n");
+			break;
+
+		default:
+			// Still escaped, as it should be.
+			fprintf(writer->fp, "<string>%.*s</string>\n", (int)value->size, value->data);
+			break;
+	}
+
+	return 0;
+}
+
+//==============================================================================
+
+int plist_write(plist_parser * parser, const plist_value * value, FILE * fp)
+{
+	plist_callbacks	callbacks	= { plist_write_begin, plist_write_end, plist_write_scalar };
+	plist_writer	writer		= { fp, 0 };
+	int				status;
+
+	fprintf(fp, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+	fprintf(fp, "<!DOCTYPE plist PUBLIC \"-//Apple//DTD PLIST 1.0//EN\" \"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">\n");
+	fprintf(fp, "<plist version=\"1.0\">\n");
+
+	status = plist_parse(parser, value, &callbacks, &writer);
+
+	fprintf(fp, "</plist>\n");
+
+	return ferror(fp) ? -1 : status;
+}
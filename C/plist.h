@@ -0,0 +1,77 @@
+/*
+ * Created..: 17 October 2026
+ * Filename.: plist.h
+ * Purpose..: Zero-copy parser for the XML plist dialect of __PRELINK_INFO.
+ */
+
+#ifndef _LZVN_PLIST_H_
+#define _LZVN_PLIST_H_
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Values are views into the XML buffer, nothing is copied or allocated, except
+// for the table of ID="n" attributes that IDREF="n" references resolve to.
+
+#define PLIST_INVALID			0
+#define PLIST_DICT				1
+#define PLIST_ARRAY				2
+#define PLIST_SET				3
+#define PLIST_KEY				4
+#define PLIST_STRING			5
+#define PLIST_INTEGER			6
+#define PLIST_DATA				7
+#define PLIST_TRUE				8
+#define PLIST_FALSE				9
+
+#define PLIST_MAX_DEPTH			64
+
+typedef struct plist_value
+{
+	int					type;
+	const char			*data;		// scalars: raw text (entities not decoded), containers: their children
+	size_t				size;
+} plist_value;
+
+typedef struct plist_parser
+{
+	const char			*xml;
+	const char			*xml_end;
+	const char			*indexed;	// ID attributes in front of this are in ids[]
+	const char			**ids;		// ID -> its element
+	size_t				id_count;
+	size_t				id_space;
+} plist_parser;
+
+// SAX style interface, see plist_parse(). key is NULL for array/set members
+// and the value plist_parse() was called with. A non-zero return stops parsing.
+typedef struct plist_callbacks
+{
+	int					(*begin)(void * context, const plist_value * key, const plist_value * value);
+	int					(*end)(void * context, const plist_value * value);
+	int					(*scalar)(void * context, const plist_value * key, const plist_value * value);
+} plist_callbacks;
+
+extern int plist_init(plist_parser * parser, const char * xml, size_t size);
+extern void plist_free(plist_parser * parser);
+
+// Indexes all ID attributes up front. After that the parser is only read, and
+// can be shared between threads.
+extern int plist_index_all(plist_parser * parser);
+
+// Lazy lookup: these return 1 on success, 0 when not found (or at the end) and -1 on invalid XML.
+extern int plist_root(plist_parser * parser, plist_value * value);
+extern int plist_next(plist_parser * parser, const plist_value * container, const char ** cursor, plist_value * key, plist_value * value);
+extern int plist_dict_get(plist_parser * parser, const plist_value * dict, const char * key, plist_value * value);
+
+extern int plist_parse(plist_parser * parser, const plist_value * value, const plist_callbacks * callbacks, void * context);
+
+extern int plist_integer(const plist_value * value, uint64_t * number);
+extern size_t plist_string(const plist_value * value, char * buffer, size_t size);
+extern int plist_string_equal(const plist_value * value, const char * string);
+
+// Writes value as an XML plist (like CFPropertyListCreateData), IDREFs expanded.
+extern int plist_write(plist_parser * parser, const plist_value * value, FILE * fp);
+
+#endif /* _LZVN_PLIST_H_ */
@@ -7,4 +7,117 @@
 
 extern size_t lzvn_encode(void * dst, size_t dst_size, const void * src, size_t src_size, void * work_space);
 extern size_t lzvn_decode(void * dst, size_t dst_size, const void * src, size_t src_size);
+extern size_t lzvn_encode_asm(void * dst, size_t dst_size, const void * src, size_t src_size, void * work_space);
+extern size_t lzvn_encode_c(void * dst, size_t dst_size, const void * src, size_t src_size, void * work_space);
+extern size_t lzvn_decode_asm(void * dst, size_t dst_size, const void * src, size_t src_size);
+extern size_t lzvn_decode_switch(void * dst, size_t dst_size, const void * src, size_t src_size);
+extern size_t lzvn_decode_threaded(void * dst, size_t dst_size, const void * src, size_t src_size);
+extern size_t lzvn_decode_threaded_ssse3(void * dst, size_t dst_size, const void * src, size_t src_size);
+extern size_t lzvn_decode_threaded_avx2(void * dst, size_t dst_size, const void * src, size_t src_size);
+extern size_t lzvn_decode_threaded_adler32(void * dst, size_t dst_size, const void * src, size_t src_size, uint32_t * adler32);
+extern size_t lzvn_decode_threaded_adler32_ssse3(void * dst, size_t dst_size, const void * src, size_t src_size, uint32_t * adler32);
+extern size_t lzvn_decode_threaded_adler32_avx2(void * dst, size_t dst_size, const void * src, size_t src_size, uint32_t * adler32);
+
+typedef size_t (*lzvn_decode_func)(void * dst, size_t dst_size, const void * src, size_t src_size);
+typedef size_t (*lzvn_decode_adler32_func)(void * dst, size_t dst_size, const void * src, size_t src_size, uint32_t * adler32);
+typedef size_t (*lzvn_encode_func)(void * dst, size_t dst_size, const void * src, size_t src_size, void * work_space);
+
+extern int lzvn_select_decoder(const char * name);
+extern int lzvn_select_encoder(const char * name);
+extern const char * lzvn_decoder_name(void);
+extern const char * lzvn_encoder_name(void);
+extern const char * lzvn_decoder_backend_name(int index);
+extern const char * lzvn_encoder_backend_name(int index);
 extern size_t lzvn_encode_work_size(void);
+extern size_t lzvn_encode_work_size_for(size_t src_size);
+
+#define LZVN_MAX_LEVEL			9
+#define LZVN_DEFAULT_LEVEL		5		// table fits in lzvn_encode_work_size()
+
+extern size_t lzvn_encode_level(void * dst, size_t dst_size, const void * src, size_t src_size, void * work_space, int level);
+extern size_t lzvn_encode_level_work_size(size_t src_size, int level);
+extern size_t lzvn_encode_parallel(void * dst, size_t dst_size, const void * src, size_t src_size, int threads, int level);
+extern size_t lzvn_encode_stored(void * dst, size_t dst_size, const void * src, size_t src_size);
+extern size_t lzvn_encode_bound(size_t src_size);
+extern uint32_t lzvn_adler32(uint32_t adler32, const uint8_t * buffer, size_t length);
+
+#define LZSS_MAX_LEVEL			9
+#define LZSS_DEFAULT_LEVEL		5
+#define LZSS_ENCODE_BOUND(n)	((n) + (((n) + 7) / 8))
+
+extern size_t lzss_encode(void * dst, size_t dst_size, const void * src, size_t src_size, int level);
+
+typedef struct lzvn_encoder_stream lzvn_encoder_stream;
+
+extern lzvn_encoder_stream * lzvn_encoder_init(void);
+extern size_t lzvn_encoder_feed(lzvn_encoder_stream * stream, void * dst, size_t dst_size, const void * src, size_t src_size, size_t * src_used);
+extern size_t lzvn_encoder_flush(lzvn_encoder_stream * stream, void * dst, size_t dst_size);
+extern size_t lzvn_encoder_finish(lzvn_encoder_stream * stream, void * dst, size_t dst_size);
+extern void lzvn_encoder_free(lzvn_encoder_stream * stream);
+
+typedef struct lzvn_decoder_state
+{
+	const unsigned char	*src;			// next compressed byte
+	const unsigned char	*src_end;
+	unsigned char		*dst_begin;		// matches may reference dst_begin..dst
+	unsigned char		*dst;			// next output byte
+	unsigned char		*dst_end;
+	size_t				L;				// literals left to copy
+	size_t				M;				// match bytes left to copy
+	size_t				D;				// match distance
+	int					end_of_stream;
+} lzvn_decoder_state;
+
+#define LZVN_DECODER_HISTORY	0x10000
+
+extern void lzvn_decoder_init(lzvn_decoder_state * state, void * dst, size_t dst_size);
+extern int lzvn_decoder_run(lzvn_decoder_state * state);
+extern size_t lzvn_decoder_slide(lzvn_decoder_state * state);
+
+// lzvn_decode() that also updates *adler32 with the output, LZVN_ADLER32_SPAN
+// bytes at a time while they are still in cache (asm and switch: in a second pass).
+#define LZVN_ADLER32_SPAN		0x8000
+
+extern size_t lzvn_decode_adler32(void * dst, size_t dst_size, const void * src, size_t src_size, uint32_t * adler32);
+
+// Checkpoint index (lzvn -index): the decoder state every spacing bytes of
+// output, with the LZVN_DECODER_HISTORY bytes in front of it (no match reaches
+// further back), so lzvn_decode_range() can start decoding near any offset.
+// A header followed by count entries, written to disk as is.
+
+#define LZVN_INDEX_MAGIC		0x78696c7a		// 'zlix'
+#define LZVN_INDEX_SPACING		(4 << 20)
+
+typedef struct lzvn_index_header
+{
+	uint32_t			magic;
+	uint32_t			count;			// entries, one per spacing bytes of output
+	uint32_t			adler32;		// of the decoded data
+	uint32_t			reserved;
+	uint64_t			spacing;
+	uint64_t			src_size;		// compressed stream
+	uint64_t			dst_size;		// decoded data
+} lzvn_index_header;
+
+typedef struct lzvn_index_entry
+{
+	uint64_t			src_offset;		// next compressed byte
+	uint64_t			dst_offset;		// = entry number * spacing
+	uint32_t			L;				// decoder state (see lzvn_decoder_state)
+	uint32_t			M;
+	uint32_t			D;
+	uint32_t			window_size;	// bytes of output before dst_offset in window
+	unsigned char		window[LZVN_DECODER_HISTORY];
+} lzvn_index_entry;
+
+extern size_t lzvn_index_size(size_t dst_size, size_t spacing);
+extern size_t lzvn_decode_index(void * dst, size_t dst_size, const void * src, size_t src_size, void * index, size_t index_size, size_t spacing);
+extern size_t lzvn_decode_range(void * dst, size_t offset, size_t size, const void * src, size_t src_size, const void * index, size_t index_size);
+
+// Compressed data stored at the end of a dst_size + margin buffer can be
+// decoded in place. LZVN_IN_PLACE_MARGIN(src_size) is enough for streams from
+// lzvn_encode*(), lzvn_decode_in_place_margin() gives the exact margin.
+#define LZVN_IN_PLACE_MARGIN(n)	(((n) >> 6) + 4096)
+
+extern size_t lzvn_decode_in_place_margin(const void * src, size_t src_size, size_t dst_size);
+extern size_t lzvn_decode_in_place(void * buffer, size_t buffer_size, size_t dst_size, size_t src_size, uint32_t * adler32);
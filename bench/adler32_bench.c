@@ -0,0 +1,151 @@
+/*
+ * Created..: 16 October 2026
+ * Filename.: adler32_bench.c
+ * Purpose..: Compare the Adler-32 kernels in C/adler32.c with the byte loop
+ *            from kext_tools (the previous local_adler32_update).
+ *
+ * Usage....: adler32_bench [<file>] [<MB>] [<rounds>]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "../C/adler32.h"
+
+//==============================================================================
+// Copied from: kext_tools/kext_tools-326.95.1/kernelcache.c
+
+static uint32_t kext_tools_adler32(uint32_t aAdler32, const uint8_t * aBuffer, size_t aLength)
+{
+	int32_t		cnt;
+	uint32_t	lowHalf		= aAdler32 & 0xffff;
+	uint32_t	highHalf	= aAdler32 >> 16;
+
+	for (cnt = 0; cnt < (int32_t)aLength; cnt++)
+	{
+		if ((cnt % 5000) == 0)
+		{
+			lowHalf  %= 65521L;
+			highHalf %= 65521L;
+		}
+
+		lowHalf += aBuffer[cnt];
+		highHalf += lowHalf;
+	}
+
+	lowHalf  %= 65521L;
+	highHalf %= 65521L;
+
+	return (highHalf << 16) | lowHalf;
+}
+
+//==============================================================================
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//==============================================================================
+
+int main(int argc, const char * argv[])
+{
+	struct
+	{
+		const char	*name;
+		uint32_t	(*func)(uint32_t, const uint8_t *, size_t);
+	} kernels[] =
+	{
+		{ "kext_tools",	kext_tools_adler32 },
+		{ "scalar",		lzvn_adler32_scalar },
+		{ "ssse3",		lzvn_adler32_ssse3 },
+		{ "avx2",		lzvn_adler32_avx2 },
+		{ "dispatch",	lzvn_adler32 }
+	};
+
+	size_t		size	= (argc > 2) ? (size_t)atol(argv[2]) << 20 : (64 << 20);
+	int			rounds	= (argc > 3) ? atoi(argv[3]) : 5;
+	uint8_t		*buffer;
+	uint32_t	expected = 0;
+	size_t		i;
+	int			k, r;
+
+	if (argc > 1 && strcmp(argv[1], "-") != 0)
+	{
+		FILE *fp = fopen(argv[1], "rb");
+
+		if (fp == NULL)
+		{
+			printf("ERROR: Opening %s failed!\n", argv[1]);
+			return -1;
+		}
+
+		fseek(fp, 0, SEEK_END);
+		size = (size_t)ftell(fp);
+		rewind(fp);
+
+		if ((buffer = malloc(size)) == NULL || fread(buffer, 1, size, fp) != size)
+		{
+			printf("ERROR: Reading %s failed!\n", argv[1]);
+			fclose(fp);
+			return -1;
+		}
+
+		fclose(fp);
+	}
+	else
+	{
+		if ((buffer = malloc(size)) == NULL)
+		{
+			printf("ERROR: Allocating %ld bytes failed!\n", (long)size);
+			return -1;
+		}
+
+		srand(1);
+
+		for (i = 0; i < size; i++)
+		{
+			buffer[i] = (uint8_t)rand();
+		}
+	}
+
+	printf("size.........: %ld bytes, %d rounds, dispatch uses %s\n", (long)size, rounds, lzvn_adler32_kernel());
+
+	for (k = 0; k < (int)(sizeof(kernels) / sizeof(kernels[0])); k++)
+	{
+		double		best	= 1e30;
+		uint32_t	value	= 0;
+
+		for (r = 0; r < rounds; r++)
+		{
+			double start = now();
+
+			value = kernels[k].func(1, buffer, size);
+			start = now() - start;
+
+			if (start < best)
+			{
+				best = start;
+			}
+		}
+
+		if (k == 0)
+		{
+			expected = value;
+		}
+
+		printf("%-12s : 0x%08x %9.1f MB/s %s\n", kernels[k].name, value, (size / 1048576.0) / best,
+			   (value == expected) ? "" : "MISMATCH");
+	}
+
+	free(buffer);
+
+	return 0;
+}
@@ -0,0 +1,383 @@
+/*
+ * Created..: 16 October 2026
+ * Filename.: lzvn_bench.c
+ * Purpose..: In-memory benchmark of the codecs used by lzvn: lzvn_encode and
+ *            lzvn_decode (every backend this CPU can run), lzvn_encode_level
+ *            (every level), lzss_encode,
+ *            decompress_lzss and local_adler32.
+ *
+ * Usage....: lzvn_bench [-r <rounds>] [-csv] <file> [<file> ...]
+ *
+ * Each file is used as is, unless it is a compressed prelinkedkernel (with or
+ * without FAT header), in which case it is decoded first. Every test runs
+ * <rounds> times (default 7) and reports the median. MB/s and cycles/byte are
+ * relative to the uncompressed size, ratio is uncompressed/compressed. Cycles
+ * are TSC ticks on x86_64 (they run at the nominal clock, not the boost clock).
+ *
+ * With -csv the output is one line per test, for diffing codec changes:
+ *
+ *   file,test,bytes,compressed,ratio,mb_s,cycles_per_byte,rounds
+ */
+
+#include "../lzvn.h"
+
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_TSC		1
+#else
+#define BENCH_TSC		0
+#endif
+
+#define BENCH_MAX_ROUNDS	101
+
+typedef struct
+{
+	const char		*name;
+	const uint8_t	*data;				// uncompressed input
+	size_t			size;
+	const uint8_t	*lzvn;				// lzvn_encode output
+	size_t			lzvnSize;
+	const uint8_t	*lzss;				// lzss_encode output
+	size_t			lzssSize;
+	uint8_t			*scratch;			// large enough for any result
+	size_t			scratchSize;
+	void			*workSpace;			// large enough for any level
+	int				level;				// for lzvn_encode_level
+	uint32_t		adler32;
+} bench_input;
+
+typedef size_t (*bench_test)(bench_input *aInput);
+
+enum
+{
+	BENCH_ENCODE,			// ratio from the result size
+	BENCH_DECODE,			// output compared with the input
+	BENCH_CHECKSUM			// no ratio
+};
+
+static int			gRounds	= 7;
+static boolean_t	gCSV	= FALSE;
+
+//==============================================================================
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t ticks(void)
+{
+#if BENCH_TSC
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+static int compare_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+//==============================================================================
+// Tests. Each returns the size it produced (0 = failure), the output is left
+// in aInput->scratch for checking.
+
+static size_t test_lzvn_encode(bench_input *aInput)
+{
+	// The backend is set with lzvn_select_encoder().
+	return lzvn_encode(aInput->scratch, aInput->scratchSize, aInput->data, aInput->size, aInput->workSpace);
+}
+
+static size_t test_lzvn_encode_level(bench_input *aInput)
+{
+	return lzvn_encode_level(aInput->scratch, aInput->scratchSize, aInput->data, aInput->size, aInput->workSpace, aInput->level);
+}
+
+static size_t test_lzss_encode(bench_input *aInput)
+{
+	return lzss_encode(aInput->scratch, aInput->scratchSize, aInput->data, aInput->size, LZSS_DEFAULT_LEVEL);
+}
+
+static size_t test_lzvn_decode(bench_input *aInput)
+{
+	// The backend is set with lzvn_select_decoder().
+	return lzvn_decode(aInput->scratch, aInput->size, aInput->lzvn, aInput->lzvnSize);
+}
+
+static size_t test_decompress_lzss(bench_input *aInput)
+{
+	u_int32_t adler32 = 1;
+
+	return decompress_lzss(aInput->scratch, aInput->size, (uint8_t *)aInput->lzss, (u_int32_t)aInput->lzssSize, &adler32);
+}
+
+static size_t test_local_adler32(bench_input *aInput)
+{
+	return (local_adler32((uint8_t *)aInput->data, (int32_t)aInput->size) == aInput->adler32) ? aInput->size : 0;
+}
+
+//==============================================================================
+
+static void run_test(bench_input *aInput, const char *aName, bench_test aTest, size_t aCompressed, int aKind)
+{
+	double		seconds[BENCH_MAX_ROUNDS];
+	double		cycles[BENCH_MAX_ROUNDS];
+	size_t		result	= 0;
+	boolean_t	ok		= TRUE;
+	int			r;
+
+	for (r = 0; r < gRounds; r++)
+	{
+		double		start	= now();
+		uint64_t	tsc		= ticks();
+
+		result		= aTest(aInput);
+		cycles[r]	= (double)(ticks() - tsc);
+		seconds[r]	= now() - start;
+
+		if (result == 0)
+		{
+			ok = FALSE;
+		}
+	}
+
+	if ((aKind == BENCH_DECODE) && ((result != aInput->size) || memcmp(aInput->scratch, aInput->data, aInput->size)))
+	{
+		ok = FALSE;
+	}
+
+	if (aKind == BENCH_ENCODE)
+	{
+		aCompressed = result;
+	}
+
+	qsort(seconds, gRounds, sizeof(double), compare_double);
+	qsort(cycles, gRounds, sizeof(double), compare_double);
+
+	double mbs		= (aInput->size / 1048576.0) / seconds[gRounds / 2];
+	double cpb		= cycles[gRounds / 2] / aInput->size;
+	double ratio	= aCompressed ? ((double)aInput->size / aCompressed) : 0.0;
+
+	if (gCSV)
+	{
+		printf("%s,%s,%ld,%ld,%.4f,%.1f,%.3f,%d%s\n", aInput->name, aName, (long)aInput->size, (long)aCompressed, ratio, mbs, cpb, gRounds, ok ? "" : ",FAILED");
+	}
+	else
+	{
+		printf("%-20s : %9.1f MB/s %8.3f cycles/byte", aName, mbs, cpb);
+
+		if (aCompressed)
+		{
+			printf(" ratio %.3f", ratio);
+		}
+
+		printf("%s\n", ok ? "" : " FAILED");
+	}
+}
+
+//==============================================================================
+// Reads aPath, and decodes it when it is a compressed prelinkedkernel.
+
+static uint8_t * load_input(const char *aPath, size_t *aSize)
+{
+	FILE		*fp;
+	uint8_t		*fileBuffer	= NULL;
+	uint8_t		*data		= NULL;
+	size_t		fileSize	= 0;
+	size_t		offset		= 0;
+	u_int32_t	adler32		= 1;
+
+	if ((fp = fopen(aPath, "rb")) == NULL)
+	{
+		printf("ERROR: Opening %s failed!\n", aPath);
+		return NULL;
+	}
+
+	fseek(fp, 0, SEEK_END);
+	fileSize = (size_t)ftell(fp);
+	rewind(fp);
+
+	if ((fileSize == 0) || ((fileBuffer = malloc(fileSize)) == NULL) || (fread(fileBuffer, 1, fileSize, fp) != fileSize))
+	{
+		printf("ERROR: Reading %s failed!\n", aPath);
+		fclose(fp);
+		free(fileBuffer);
+		return NULL;
+	}
+
+	fclose(fp);
+
+	// FAT header? Use the first architecture.
+	if ((fileSize > 28) && (((struct fat_header *)fileBuffer)->magic == FAT_CIGAM))
+	{
+		offset = OSSwapInt32(((struct fat_arch *)(fileBuffer + sizeof(struct fat_header)))->offset);
+	}
+
+	PrelinkedKernelHeader *header = (PrelinkedKernelHeader *)(fileBuffer + offset);
+
+	if (((offset + sizeof(PrelinkedKernelHeader)) >= fileSize) || (header->signature != OSSwapInt32('comp')))
+	{
+		*aSize = fileSize;
+		return fileBuffer;
+	}
+
+	*aSize	= OSSwapInt32(header->uncompressedSize);
+	data	= malloc(*aSize);
+
+	if ((data == NULL)
+		|| ((header->compressType == OSSwapInt32('lzvn'))
+			&& (lzvn_decode(data, *aSize, header->data, OSSwapInt32(header->compressedSize)) != *aSize))
+		|| ((header->compressType == OSSwapInt32('lzss'))
+			&& (decompress_lzss(data, *aSize, (uint8_t *)header->data, OSSwapInt32(header->compressedSize), &adler32) != *aSize))
+		|| ((header->compressType != OSSwapInt32('lzvn')) && (header->compressType != OSSwapInt32('lzss'))))
+	{
+		printf("ERROR: Decoding %s failed!\n", aPath);
+		free(data);
+		data = NULL;
+	}
+
+	free(fileBuffer);
+
+	return data;
+}
+
+//==============================================================================
+
+int main(int argc, const char * argv[])
+{
+	char		testName[64];
+	const char	*backend;
+	int			i, b;
+
+	while ((argc > 1) && (argv[1][0] == '-'))
+	{
+		if (!strcmp(argv[1], "-csv"))
+		{
+			gCSV = TRUE;
+			argc--;
+			argv++;
+		}
+		else if (!strcmp(argv[1], "-r") && (argc > 2))
+		{
+			gRounds = atoi(argv[2]);
+			argc -= 2;
+			argv += 2;
+		}
+		else
+		{
+			break;
+		}
+	}
+
+	if ((argc < 2) || (gRounds < 1) || (gRounds > BENCH_MAX_ROUNDS))
+	{
+		printf("Usage: lzvn_bench [-r <rounds (1-%d)>] [-csv] <file> [<file> ...]\n", BENCH_MAX_ROUNDS);
+		return -1;
+	}
+
+	if (gCSV)
+	{
+		printf("file,test,bytes,compressed,ratio,mb_s,cycles_per_byte,rounds\n");
+	}
+
+	for (i = 1; i < argc; i++)
+	{
+		bench_input	input;
+		uint8_t		*lzvn;
+		uint8_t		*lzss;
+		size_t		workSpaceSize	= 0;
+		int			level;
+
+		memset(&input, 0, sizeof(input));
+
+		input.name = argv[i];
+		input.data = load_input(argv[i], &input.size);
+
+		if (input.data == NULL)
+		{
+			continue;
+		}
+
+		for (level = 1; level <= LZVN_MAX_LEVEL; level++)
+		{
+			if (lzvn_encode_level_work_size(input.size, level) > workSpaceSize)
+			{
+				workSpaceSize = lzvn_encode_level_work_size(input.size, level);
+			}
+		}
+
+		input.scratchSize	= LZSS_ENCODE_BOUND(input.size) + 4096;
+		input.scratch		= malloc(input.scratchSize);
+		input.workSpace		= malloc(workSpaceSize);
+		input.adler32		= local_adler32((uint8_t *)input.data, (int32_t)input.size);
+		lzvn				= malloc(input.scratchSize);
+		lzss				= malloc(input.scratchSize);
+
+		if ((input.scratch == NULL) || (input.workSpace == NULL) || (lzvn == NULL) || (lzss == NULL))
+		{
+			printf("ERROR: Failed to allocate buffers for %s\n", argv[i]);
+			return -1;
+		}
+
+		lzvn_select_encoder(NULL);
+		lzvn_select_decoder(NULL);
+
+		input.lzvnSize	= lzvn_encode(lzvn, input.scratchSize, input.data, input.size, input.workSpace);
+		input.lzssSize	= lzss_encode(lzss, input.scratchSize, input.data, input.size, LZSS_DEFAULT_LEVEL);
+		input.lzvn		= lzvn;
+		input.lzss		= lzss;
+
+		if (!gCSV)
+		{
+			printf("input........: %s, %ld bytes, %d rounds (median)\n", input.name, (long)input.size, gRounds);
+		}
+
+		for (b = 0; (backend = lzvn_encoder_backend_name(b)) != NULL; b++)
+		{
+			lzvn_select_encoder(backend);
+			snprintf(testName, sizeof(testName), "lzvn_encode_%s", backend);
+			run_test(&input, testName, test_lzvn_encode, 0, BENCH_ENCODE);
+		}
+
+		for (input.level = 1; input.level <= LZVN_MAX_LEVEL; input.level++)
+		{
+			snprintf(testName, sizeof(testName), "lzvn_encode_l%d", input.level);
+			run_test(&input, testName, test_lzvn_encode_level, 0, BENCH_ENCODE);
+		}
+
+		run_test(&input, "lzss_encode", test_lzss_encode, 0, BENCH_ENCODE);
+
+		for (b = 0; input.lzvnSize && ((backend = lzvn_decoder_backend_name(b)) != NULL); b++)
+		{
+			if (lzvn_select_decoder(backend) == 0)
+			{
+				snprintf(testName, sizeof(testName), "lzvn_decode_%s", backend);
+				run_test(&input, testName, test_lzvn_decode, input.lzvnSize, BENCH_DECODE);
+			}
+		}
+
+		if (input.lzssSize)
+		{
+			run_test(&input, "decompress_lzss", test_decompress_lzss, input.lzssSize, BENCH_DECODE);
+		}
+
+		run_test(&input, "local_adler32", test_local_adler32, 0, BENCH_CHECKSUM);
+
+		free((void *)input.data);
+		free(input.scratch);
+		free(input.workSpace);
+		free(lzvn);
+		free(lzss);
+	}
+
+	return 0;
+}
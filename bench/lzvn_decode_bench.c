@@ -0,0 +1,199 @@
+/*
+ * Created..: 16 October 2026
+ * Filename.: lzvn_decode_bench.c
+ * Purpose..: Compare the LZVN decoder backends on the same input: lzvn_decode.s,
+ *            the switch() based C decoder and the direct-threaded C decoder
+ *            (plain, SSSE3 and AVX2 builds). Backends this CPU can't run are
+ *            skipped.
+ *
+ * Usage....: lzvn_decode_bench <file> [<rounds>]
+ *
+ * The file is encoded with lzvn_encode() first, unless it is an LZVN
+ * compressed prelinkedkernel (with or without FAT header), in which case its
+ * data is used as is.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <libkern/OSByteOrder.h>
+
+#include "../FastCompression.h"
+
+//==============================================================================
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//==============================================================================
+// Number of opcodes in an LZVN stream (up to and including the eos opcode).
+
+static size_t count_tokens(const uint8_t * src, size_t size)
+{
+	const uint8_t	*end	= src + size;
+	size_t			tokens	= 0;
+
+	while (src < end)
+	{
+		uint8_t opcode = src[0];
+
+		tokens++;
+
+		if (opcode >= 0xf0)
+		{
+			src += (opcode == 0xf0) ? 2 : 1;											// lrg_m, sml_m
+		}
+		else if (opcode >= 0xe0)
+		{
+			src += (opcode == 0xe0) ? (2 + 16 + src[1]) : (1 + (opcode & 0x0f));		// lrg_l, sml_l
+		}
+		else if ((opcode >= 0xa0) && (opcode < 0xc0))
+		{
+			src += 3 + ((opcode >> 3) & 3);												// med_d
+		}
+		else if (((opcode >= 0x70) && (opcode < 0x80)) || (opcode >= 0xd0))
+		{
+			break;																		// undefined
+		}
+		else if ((opcode & 7) == 6)
+		{
+			if (opcode == 0x06)
+			{
+				break;																	// eos
+			}
+
+			src += (opcode < 0x40) ? 1 : (1 + (opcode >> 6));							// nop, pre_d
+		}
+		else
+		{
+			src += (((opcode & 7) == 7) ? 3 : 2) + (opcode >> 6);						// lrg_d, sml_d
+		}
+	}
+
+	return tokens;
+}
+
+//==============================================================================
+
+int main(int argc, const char * argv[])
+{
+	FILE		*fp;
+	uint8_t		*fileBuffer		= NULL;
+	uint8_t		*compressed		= NULL;
+	uint8_t		*decompressed	= NULL;
+	uint8_t		*reference		= NULL;
+	void		*workSpace		= NULL;
+	size_t		fileSize		= 0;
+	size_t		compressedSize	= 0;
+	size_t		size			= 0;
+	size_t		offset			= 0;
+	size_t		tokens;
+	int			rounds			= (argc > 2) ? atoi(argv[2]) : 5;
+	const char	*name;
+	int			d, r;
+
+	if (argc < 2)
+	{
+		printf("Usage: %s <file> [<rounds>]\n", argv[0]);
+		return -1;
+	}
+
+	if ((fp = fopen(argv[1], "rb")) == NULL)
+	{
+		printf("ERROR: Opening %s failed!\n", argv[1]);
+		return -1;
+	}
+
+	fseek(fp, 0, SEEK_END);
+	fileSize = (size_t)ftell(fp);
+	rewind(fp);
+
+	if (((fileBuffer = malloc(fileSize)) == NULL) || (fread(fileBuffer, 1, fileSize, fp) != fileSize))
+	{
+		printf("ERROR: Reading %s failed!\n", argv[1]);
+		fclose(fp);
+		return -1;
+	}
+
+	fclose(fp);
+
+	// FAT header? Use the first architecture.
+	if ((fileSize > 28) && (*(uint32_t *)fileBuffer == 0xBEBAFECA))
+	{
+		offset = OSSwapInt32(*(uint32_t *)(fileBuffer + 16));
+	}
+
+	// Compressed prelinkedkernel?
+	if (((offset + 384) < fileSize)
+		&& (*(uint32_t *)(fileBuffer + offset) == OSSwapInt32('comp'))
+		&& (*(uint32_t *)(fileBuffer + offset + 4) == OSSwapInt32('lzvn')))
+	{
+		size           = OSSwapInt32(*(uint32_t *)(fileBuffer + offset + 12));
+		compressed     = fileBuffer + offset + 384;
+		compressedSize = OSSwapInt32(*(uint32_t *)(fileBuffer + offset + 16));
+		reference      = NULL;
+	}
+	else
+	{
+		size           = fileSize;
+		reference      = fileBuffer;
+		compressed     = malloc(lzvn_encode_bound(size));
+		workSpace      = malloc(lzvn_encode_work_size_for(size));
+		compressedSize = (compressed && workSpace) ? lzvn_encode(compressed, lzvn_encode_bound(size), fileBuffer, size, workSpace) : 0;
+	}
+
+	if ((compressedSize == 0) || ((decompressed = malloc(size)) == NULL))
+	{
+		printf("ERROR: Encoding %s failed!\n", argv[1]);
+		return -1;
+	}
+
+	tokens = count_tokens(compressed, compressedSize);
+
+	printf("input........: %s, %ld bytes, %ld compressed, %ld tokens\n", argv[1], (long)size, (long)compressedSize, (long)tokens);
+
+	for (d = 0; (name = lzvn_decoder_backend_name(d)) != NULL; d++)
+	{
+		double	best	= 1e30;
+		size_t	result	= 0;
+
+		if (lzvn_select_decoder(name) != 0)
+		{
+			printf("%-12s : not supported by this CPU\n", name);
+			continue;
+		}
+
+		for (r = 0; r < rounds; r++)
+		{
+			double start = now();
+
+			result = lzvn_decode(decompressed, size, compressed, compressedSize);
+			start = now() - start;
+
+			if (start < best)
+			{
+				best = start;
+			}
+		}
+
+		if (reference == NULL)
+		{
+			reference = malloc(size);
+			memcpy(reference, decompressed, size);
+		}
+
+		printf("%-12s : %9.1f MB/s %9.2f Mtokens/s %s\n", name, (size / 1048576.0) / best, (tokens / 1e6) / best,
+			   ((result == size) && (memcmp(decompressed, reference, size) == 0)) ? "" : "MISMATCH");
+	}
+
+	return 0;
+}
@@ -0,0 +1,435 @@
+/*
+ * Created..: 16 October 2026
+ * Filename.: mkprelinkedkernel.c
+ * Purpose..: Generate a synthetic prelinkedkernel for benchmarks, so the codec
+ *            and the extraction paths (is_prelinkedkernel, saveKernel,
+ *            listKexts) can be measured at any size without a real one.
+ *
+ * Usage....: mkprelinkedkernel [-kexts <n>] [-size <MB>] [-entropy <0-100>]
+ *                              [-seed <n>] [-lzvn] <outfile>
+ *
+ *   -kexts    number of kexts in __PRELINK_TEXT (default 200).
+ *   -size     total image size in MB, 10 to 1024 (default 64).
+ *   -entropy  percentage of random bytes in code/data (default 15), the rest
+ *             is made of repeated instruction-like snippets and zero runs.
+ *   -seed     seed for the generator, the same seed gives the same image.
+ *   -lzvn     write the image LZVN compressed, with the gFileHeader FAT and
+ *             'comp'/'lzvn' header (same as: lzvn <image> <outfile>).
+ *
+ * Layout (all offsets page aligned):
+ *
+ *   __TEXT          mach header and load commands.
+ *   __TEXT_EXEC     the kernel, a complete Mach-O with __TEXT, __TEXT_EXEC,
+ *                   __LAST and __LINKEDIT (offsets relative to its header).
+ *   __PRELINK_TEXT  the kexts, each one an MH_KEXT_BUNDLE Mach-O. Every third
+ *                   one has an LC_CODE_SIGNATURE load command.
+ *   __PRELINK_INFO  the serialized _PrelinkInfoDictionary (C/plist.c).
+ *   __LINKEDIT      symbol-table like data, padded to the requested size.
+ */
+
+#include "../lzvn.h"
+
+#ifndef MH_KEXT_BUNDLE
+#define MH_KEXT_BUNDLE			0xb
+#endif
+
+#ifndef CPU_TYPE_X86_64
+#define CPU_TYPE_X86_64			(7 | 0x01000000)
+#endif
+
+#define PK_PAGE_SIZE			0x1000
+#define PK_ROUND_PAGE(x)		(((x) + (PK_PAGE_SIZE - 1)) & ~(uint64_t)(PK_PAGE_SIZE - 1))
+#define PK_VM_BASE				0xffffff8000000000ULL
+#define PK_SNIPPET_SIZE			32
+#define PK_SNIPPETS				256
+#define PK_PLIST_PER_KEXT		1024		// upper limit of one kext entry in the plist
+
+typedef struct
+{
+	uint64_t	offset;						// file offset of the kext mach header
+	uint64_t	size;
+} pk_kext;
+
+static uint64_t	gRandom		= 0x2545f4914f6cdd1dULL;
+static uint8_t	gSnippets[PK_SNIPPETS][PK_SNIPPET_SIZE];
+
+//==============================================================================
+
+static uint64_t next_random(void)
+{
+	// xorshift64*
+	gRandom ^= gRandom >> 12;
+	gRandom ^= gRandom << 25;
+	gRandom ^= gRandom >> 27;
+
+	return gRandom * 0x2545f4914f6cdd1dULL;
+}
+
+//==============================================================================
+// Fills aLength bytes: aEntropy percent random, the rest either zero runs or
+// snippets from a small table with one byte changed (like a new displacement
+// or immediate), which compresses about like real x86_64 code.
+
+static void fill_payload(uint8_t *aBuffer, uint64_t aLength, int aEntropy)
+{
+	while (aLength > 0)
+	{
+		uint64_t	r		= next_random();
+		uint64_t	chunk	= (aLength < PK_SNIPPET_SIZE) ? aLength : PK_SNIPPET_SIZE;
+		uint64_t	i;
+
+		if ((int)(r % 100) < aEntropy)
+		{
+			for (i = 0; i < chunk; i += 8)
+			{
+				uint64_t value = next_random();
+
+				memcpy(aBuffer + i, &value, ((chunk - i) < 8) ? (chunk - i) : 8);
+			}
+		}
+		else if (((r >> 8) & 7) == 0)
+		{
+			memset(aBuffer, 0, chunk);
+		}
+		else
+		{
+			memcpy(aBuffer, gSnippets[(r >> 16) & (PK_SNIPPETS - 1)], chunk);
+			aBuffer[(r >> 32) % chunk] = (uint8_t)(r >> 24);
+		}
+
+		aBuffer += chunk;
+		aLength -= chunk;
+	}
+}
+
+//==============================================================================
+
+static void write_mach_header(uint8_t *aBuffer, uint32_t aFileType, uint32_t aCommands, uint32_t aCommandsSize)
+{
+	struct mach_header_64 *header = (struct mach_header_64 *)aBuffer;
+
+	header->magic		= MH_MAGIC_64;
+	header->cputype		= CPU_TYPE_X86_64;
+	header->cpusubtype	= 3;
+	header->filetype	= aFileType;
+	header->ncmds		= aCommands;
+	header->sizeofcmds	= aCommandsSize;
+	header->flags		= 1;
+	header->reserved	= 0;
+}
+
+//==============================================================================
+// Writes an LC_SEGMENT_64 with one section, returns the next load command.
+
+static uint8_t * add_segment(uint8_t *aCommand, const char *aSegment, const char *aSection, uint64_t aVMAddress, uint64_t aFileOffset, uint64_t aSize)
+{
+	struct segment_command_64	*segment = (struct segment_command_64 *)aCommand;
+	struct section_64			*section = (struct section_64 *)(aCommand + sizeof(struct segment_command_64));
+
+	memset(aCommand, 0, sizeof(struct segment_command_64) + sizeof(struct section_64));
+
+	segment->cmd		= LC_SEGMENT_64;
+	segment->cmdsize	= sizeof(struct segment_command_64) + sizeof(struct section_64);
+	strncpy(segment->segname, aSegment, sizeof(segment->segname));
+	segment->vmaddr		= aVMAddress;
+	segment->vmsize		= PK_ROUND_PAGE(aSize);
+	segment->fileoff	= aFileOffset;
+	segment->filesize	= aSize;
+	segment->maxprot	= 7;
+	segment->initprot	= 7;
+	segment->nsects		= 1;
+
+	strncpy(section->sectname, aSection, sizeof(section->sectname));
+	strncpy(section->segname, aSegment, sizeof(section->segname));
+	section->addr		= aVMAddress;
+	section->size		= aSize;
+	section->offset		= (uint32_t)aFileOffset;
+
+	return aCommand + segment->cmdsize;
+}
+
+//==============================================================================
+// The kernel Mach-O at aBuffer, aCodeSize bytes of code and aLinkeditSize
+// bytes of __LINKEDIT. Returns its size.
+
+static uint64_t build_kernel(uint8_t *aBuffer, uint64_t aVMAddress, uint64_t aCodeSize, uint64_t aLinkeditSize, int aEntropy)
+{
+	uint64_t	textExec	= PK_PAGE_SIZE;
+	uint64_t	last		= textExec + PK_ROUND_PAGE(aCodeSize);
+	uint64_t	linkedit	= last + PK_PAGE_SIZE;
+	uint8_t		*command	= aBuffer + sizeof(struct mach_header_64);
+
+	command = add_segment(command, "__TEXT", "__const", aVMAddress, 0, PK_PAGE_SIZE);
+	command = add_segment(command, "__TEXT_EXEC", "__text", aVMAddress + textExec, textExec, aCodeSize);
+	command = add_segment(command, "__PRELINK_TEXT", "__text", aVMAddress + linkedit, linkedit, 0);
+	command = add_segment(command, "__PRELINK_INFO", "__info", aVMAddress + linkedit, linkedit, 0);
+	command = add_segment(command, "__LAST", "__mod_init_func", aVMAddress + last, last, PK_PAGE_SIZE);
+	command = add_segment(command, "__LINKEDIT", "__symtab", aVMAddress + linkedit, linkedit, aLinkeditSize);
+
+	write_mach_header(aBuffer, MH_EXECUTE, 6, (uint32_t)(command - aBuffer - sizeof(struct mach_header_64)));
+
+	fill_payload(aBuffer + textExec, aCodeSize, aEntropy);
+	fill_payload(aBuffer + linkedit, aLinkeditSize, aEntropy);
+
+	return linkedit + aLinkeditSize;
+}
+
+//==============================================================================
+// An MH_KEXT_BUNDLE of aSize bytes at aBuffer.
+
+static void build_kext(uint8_t *aBuffer, uint64_t aVMAddress, uint64_t aSize, boolean_t aSigned, int aEntropy)
+{
+	uint8_t *command = aBuffer + sizeof(struct mach_header_64);
+
+	command = add_segment(command, "__TEXT", "__text", aVMAddress, 0, aSize);
+
+	if (aSigned)
+	{
+		struct linkedit_data_command *signature = (struct linkedit_data_command *)command;
+
+		signature->cmd		= LC_CODE_SIGNATURE;
+		signature->cmdsize	= sizeof(struct linkedit_data_command);
+		signature->dataoff	= (uint32_t)(aSize - 256);
+		signature->datasize	= 256;
+		command += signature->cmdsize;
+	}
+
+	write_mach_header(aBuffer, MH_KEXT_BUNDLE, aSigned ? 2 : 1, (uint32_t)(command - aBuffer - sizeof(struct mach_header_64)));
+
+	fill_payload(aBuffer + PK_PAGE_SIZE, aSize - PK_PAGE_SIZE, aEntropy);
+}
+
+//==============================================================================
+// _PrelinkInfoDictionary in the format written by kext_tools. Returns the
+// length (including the terminating NUL).
+
+static uint64_t build_plist(char *aBuffer, pk_kext *aKexts, int aKextCount)
+{
+	char	*p = aBuffer;
+	int		i;
+
+	p += sprintf(p, "<dict><key>_PrelinkInfoDictionary</key><array>");
+
+	for (i = 0; i < aKextCount; i++)
+	{
+		p += sprintf(p,
+			"<dict>"
+			"<key>CFBundleIdentifier</key><string>com.example.driver.Synthetic%04d</string>"
+			"<key>CFBundleName</key><string>Synthetic%04d</string>"
+			"<key>CFBundleVersion</key><string>1.%d.%d</string>"
+			"<key>CFBundleExecutable</key><string>Synthetic%04d</string>"
+			"<key>OSBundleRequired</key><string>Root</string>"
+			"<key>" kPrelinkBundlePathKey "</key><string>/System/Library/Extensions/Synthetic%04d.kext</string>"
+			"<key>" kPrelinkExecutableRelativePathKey "</key><string>Contents/MacOS/Synthetic%04d</string>"
+			"<key>" kPrelinkExecutableSourceKey "</key><integer size=\"64\">0x%llx</integer>"
+			"<key>" kPrelinkExecutableLoadKey "</key><integer size=\"64\">0x%llx</integer>"
+			"<key>" kPrelinkExecutableSizeKey "</key><integer size=\"64\">0x%llx</integer>"
+			"<key>" kPrelinkKmodInfoKey "</key><integer size=\"64\">0x%llx</integer>"
+			"</dict>",
+			i, i, i / 10, i % 10, i, i, i,
+			(unsigned long long)(PK_VM_BASE + aKexts[i].offset),
+			(unsigned long long)(PK_VM_BASE + aKexts[i].offset),
+			(unsigned long long)aKexts[i].size,
+			(unsigned long long)(PK_VM_BASE + aKexts[i].offset + PK_PAGE_SIZE));
+	}
+
+	p += sprintf(p, "</array></dict>");
+
+	return (p - aBuffer) + 1;
+}
+
+//==============================================================================
+
+int main(int argc, const char * argv[])
+{
+	FILE		*fp;
+	pk_kext		*kexts		= NULL;
+	char		*plist		= NULL;
+	uint8_t		*image		= NULL;
+	int			kextCount	= 200;
+	int			sizeMB		= 64;
+	int			entropy		= 15;
+	boolean_t	compress	= FALSE;
+	uint64_t	totalSize, kernelCode, kernelLinkedit, kextSpace, plistSize;
+	uint64_t	kernelOffset, kernelSize, prelinkTextOffset, prelinkTextSize, prelinkInfoOffset, linkeditOffset, linkeditSize;
+	int			i;
+
+	while ((argc > 2) && (argv[1][0] == '-'))
+	{
+		if (!strcmp(argv[1], "-lzvn"))
+		{
+			compress = TRUE;
+			argc--;
+			argv++;
+			continue;
+		}
+		else if (!strcmp(argv[1], "-kexts"))
+		{
+			kextCount = atoi(argv[2]);
+		}
+		else if (!strcmp(argv[1], "-size"))
+		{
+			sizeMB = atoi(argv[2]);
+		}
+		else if (!strcmp(argv[1], "-entropy"))
+		{
+			entropy = atoi(argv[2]);
+		}
+		else if (!strcmp(argv[1], "-seed"))
+		{
+			gRandom = strtoull(argv[2], NULL, 0) | 1;
+		}
+		else
+		{
+			break;
+		}
+
+		argc -= 2;
+		argv += 2;
+	}
+
+	if ((argc != 2) || (kextCount < 1) || (sizeMB < 10) || (sizeMB > 1024) || (entropy < 0) || (entropy > 100))
+	{
+		printf("Usage: mkprelinkedkernel [-kexts <n>] [-size <MB (10-1024)>] [-entropy <0-100>] [-seed <n>] [-lzvn] <outfile>\n");
+		return -1;
+	}
+
+	totalSize		= (uint64_t)sizeMB << 20;
+	kernelCode		= PK_ROUND_PAGE(totalSize / 8);
+	kernelLinkedit	= PK_ROUND_PAGE(totalSize / 64);
+	plistSize		= 256 + (uint64_t)kextCount * PK_PLIST_PER_KEXT;
+	kextSpace		= (totalSize - kernelCode - kernelLinkedit - (totalSize / 32) - PK_ROUND_PAGE(plistSize)) / kextCount;
+
+	if (kextSpace < (2 * PK_PAGE_SIZE))
+	{
+		printf("ERROR: Too many kexts for %d MB\n", sizeMB);
+		return -1;
+	}
+
+	kexts	= calloc(kextCount, sizeof(pk_kext));
+	plist	= malloc(plistSize);
+
+	if ((kexts == NULL) || (plist == NULL))
+	{
+		printf("ERROR: Failed to allocate kext table\n");
+		return -1;
+	}
+
+	for (i = 0; i < PK_SNIPPETS; i++)
+	{
+		uint64_t	r = next_random();
+		int			j;
+
+		// Mostly small opcode/modrm values, some wider immediates.
+		for (j = 0; j < PK_SNIPPET_SIZE; j++)
+		{
+			gSnippets[i][j] = ((r >> (j % 32)) & 3) ? (uint8_t)(next_random() & 0x8f) : (uint8_t)next_random();
+		}
+	}
+
+	// The kexts, between half and one and a half times the average size.
+	kernelOffset		= PK_PAGE_SIZE;
+	kernelSize			= PK_PAGE_SIZE + kernelCode + PK_PAGE_SIZE + kernelLinkedit;
+	prelinkTextOffset	= kernelOffset + kernelSize;
+	prelinkTextSize		= 0;
+
+	for (i = 0; i < kextCount; i++)
+	{
+		uint64_t size = PK_ROUND_PAGE((kextSpace / 2) + (next_random() % kextSpace));
+
+		if ((prelinkTextSize + size) > (kextSpace * kextCount))
+		{
+			size = 2 * PK_PAGE_SIZE;
+		}
+
+		kexts[i].offset	= prelinkTextOffset + prelinkTextSize;
+		kexts[i].size	= size;
+		prelinkTextSize	+= size;
+	}
+
+	if ((prelinkTextOffset + prelinkTextSize + PK_ROUND_PAGE(plistSize) + PK_PAGE_SIZE) > totalSize)
+	{
+		totalSize = prelinkTextOffset + prelinkTextSize + PK_ROUND_PAGE(plistSize) + PK_PAGE_SIZE;
+	}
+
+	if ((image = calloc(1, totalSize)) == NULL)
+	{
+		printf("ERROR: Failed to allocate %ld bytes\n", (long)totalSize);
+		return -1;
+	}
+
+	build_kernel(image + kernelOffset, PK_VM_BASE + kernelOffset, kernelCode, kernelLinkedit, entropy);
+
+	for (i = 0; i < kextCount; i++)
+	{
+		build_kext(image + kexts[i].offset, PK_VM_BASE + kexts[i].offset, kexts[i].size, ((i % 3) == 0), entropy);
+	}
+
+	// Their Info.plist data, then __LINKEDIT up to the requested size.
+	prelinkInfoOffset	= prelinkTextOffset + prelinkTextSize;
+	plistSize			= build_plist(plist, kexts, kextCount);
+	memcpy(image + prelinkInfoOffset, plist, plistSize);
+
+	linkeditOffset	= PK_ROUND_PAGE(prelinkInfoOffset + plistSize);
+	linkeditSize	= totalSize - linkeditOffset;
+	fill_payload(image + linkeditOffset, linkeditSize, entropy);
+
+	// And the outer mach header.
+	uint8_t *command = image + sizeof(struct mach_header_64);
+
+	command = add_segment(command, "__TEXT", "__const", PK_VM_BASE, 0, PK_PAGE_SIZE);
+	command = add_segment(command, "__TEXT_EXEC", "__text", PK_VM_BASE + kernelOffset, kernelOffset, kernelSize);
+	command = add_segment(command, kPrelinkTextSegment, kPrelinkTextSection, PK_VM_BASE + prelinkTextOffset, prelinkTextOffset, prelinkTextSize);
+	command = add_segment(command, kPrelinkInfoSegment, kPrelinkInfoSection, PK_VM_BASE + prelinkInfoOffset, prelinkInfoOffset, plistSize);
+	command = add_segment(command, "__LINKEDIT", "__symtab", PK_VM_BASE + linkeditOffset, linkeditOffset, linkeditSize);
+
+	write_mach_header(image, MH_EXECUTE, 5, (uint32_t)(command - image - sizeof(struct mach_header_64)));
+
+	printf("kexts........: %d (%ld bytes in __PRELINK_TEXT)\n", kextCount, (long)prelinkTextSize);
+	printf("kernel.......: %ld bytes\n", (long)kernelSize);
+	printf("plist........: %ld bytes\n", (long)plistSize);
+	printf("entropy......: %d%%\n", entropy);
+	printf("image........: %ld bytes\n", (long)totalSize);
+
+	if ((fp = fopen(argv[1], "wb")) == NULL)
+	{
+		printf("ERROR: Open file %s\n", argv[1]);
+		return -1;
+	}
+
+	if (compress)
+	{
+		size_t	bufferSize		= lzvn_encode_bound(totalSize);
+		void	*workSpace		= malloc(lzvn_encode_work_size_for(totalSize));
+		uint8_t	*buffer			= malloc(bufferSize);
+		size_t	compressedSize	= (workSpace && buffer) ? lzvn_encode(buffer, bufferSize, image, totalSize, workSpace) : 0;
+
+		if (compressedSize == 0)
+		{
+			printf("ERROR: Encoding failed\n");
+			fclose(fp);
+			unlink(argv[1]);
+			return -1;
+		}
+
+		gFileHeader[5]	= OSSwapInt32(sizeof(gFileHeader) + compressedSize - 28);
+		gFileHeader[8]	= OSSwapInt32('lzvn');
+		gFileHeader[9]	= OSSwapInt32(local_adler32(image, (int32_t)totalSize));
+		gFileHeader[10]	= OSSwapInt32(totalSize);
+		gFileHeader[11]	= OSSwapInt32(compressedSize);
+
+		fwrite(gFileHeader, sizeof(gFileHeader), 1, fp);
+		fwrite(buffer, 1, compressedSize, fp);
+
+		printf("compressed...: %ld bytes\n", (long)compressedSize);
+	}
+	else
+	{
+		fwrite(image, 1, totalSize, fp);
+	}
+
+	printf("%ld bytes written to %s\n", ftell(fp), argv[1]);
+	fclose(fp);
+
+	return 0;
+}
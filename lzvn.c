@@ -19,6 +19,23 @@
  *      - Usage now shows 'lzvn' once.
  *      - Show list of kexts added (Pike R. Alpha, Januari 2016).
  *      - Fixed encoding of files with a FAT header (Pike R. Alpha, July 2017).
+ *      - Multi-threaded encoding option (-j) added.
+ *      - Streaming encoding/decoding option (-stream) added.
+ *      - SSSE3/AVX2 adler32 (C/adler32.c) used by local_adler32().
+ *      - Adler32 of decoded data is computed while decoding (no second pass).
+ *      - LZSS encoding option (-lzss [-l <level>]) added.
+ *      - Input files are mapped, and output is encoded/decoded into a mapped file.
+ *      - Encoder/decoder backend picked from CPUID, -encoder/-decoder options added.
+ *      - Encoder workspace (hash table) sized from the input, 32 KB for small files.
+ *      - LZVN compression levels (-l <level>) added.
+ *      - LZVN level 9 uses an optimal parse.
+ *      - LZVN decoding in place, in one buffer for the compressed and decoded data.
+ *      - LZVN output buffer sized with lzvn_encode_bound(), incompressible files no longer fail.
+ *      - Checkpoint index option (-index) added, used for ranged decoding of the dictionary/list.
+ *      - Progressive decoding option (-partial) and single kext extraction (-kext <bundle-id>) added.
+ *      - __PRELINK_INFO parsed in place by C/plist.c, IOKit/CoreFoundation no longer used.
+ *      - Kexts are written on a pool of threads (-j <threads> -d ... -kexts).
+ *      - Kexts can be written as one tar stream, to a file or stdout (-tar <file | -> -d ... -kexts).
  */
 
 #include "lzvn.h"
@@ -28,8 +45,24 @@
 
 void help ()
 {
-  printf ("Usage (encode): lzvn <infile> <outfile>\n");
-  printf ("Usage (decode): lzvn -d <infile> [<outfile> | -kernel | -dictionary | -kexts | -list]\n");
+  printf ("Usage (encode): lzvn [-encoder <name>] [-j <threads> | -stream | -lzss] [-l <level>] <infile> <outfile>\n");
+  printf ("Usage (decode): lzvn [-decoder <name>] [-j <threads> | -tar <file | ->] [-stream | -index <indexfile> | -partial] -d <infile> [<outfile> | -kernel | -dictionary | -kexts | -kext <bundle-id> | -list]\n");
+  printf ("Encoders......:");
+
+  for (int i = 0; lzvn_encoder_backend_name (i) != NULL; i++)
+  {
+    printf (" %s", lzvn_encoder_backend_name (i));
+  }
+
+  printf (" (default: %s)\nDecoders......:", lzvn_encoder_name ());
+
+  for (int i = 0; lzvn_decoder_backend_name (i) != NULL; i++)
+  {
+    printf (" %s", lzvn_decoder_backend_name (i));
+  }
+
+  printf (" (default: %s)\n", lzvn_decoder_name ());
+  printf ("Levels........: 1 (fastest) to %d (smallest), LZVN levels use the c encoder\n", LZVN_MAX_LEVEL);
 }
 
 int main (int argc, const char * argv[])
@@ -39,8 +72,8 @@ int main (int argc, const char * argv[])
   unsigned char *fileBuffer        = NULL;
   unsigned char *workSpaceBuffer   = NULL;
   unsigned char *bufend            = NULL;
-  unsigned char *buffer            = NULL;
   unsigned char *tmpFileBuffer     = NULL;
+  unsigned char *outputBuffer      = NULL;
 
   PrelinkedKernelHeader * prelinkHeader = NULL;
   struct fat_header * fatHeader         = NULL;
@@ -49,15 +82,17 @@ int main (int argc, const char * argv[])
   unsigned int offset           = 0;
 
   unsigned long fileLength      = 0;
-  unsigned long byteshandled    = 0;
   unsigned long file_adler32    = 0;
-  unsigned long buffer_adler32  = 0;
+  u_int32_t     buffer_adler32  = 1;      // Of the decoded data.
 
   size_t compressedSize = 0;
   size_t workSpaceSize  = 0;
+  size_t bufferSize     = 0;      // workSpaceSize plus the in-place margin.
+  size_t inputLength    = 0;
+
+  int outputFd  = -1;
 
   int ret = -1;
-  int i   = 0;
 
   int         optArgsCount  = 0;
   const char  *optInput     = NULL;
@@ -68,6 +103,105 @@ int main (int argc, const char * argv[])
   boolean_t   optDictionary = FALSE;
   boolean_t   optKexts      = FALSE;
   boolean_t   optList       = FALSE;
+  boolean_t   optStream     = FALSE;
+  int         optThreads    = 0;
+  boolean_t   optLZSS       = FALSE;
+  int         optLevel      = 0;
+  const char  *optIndex     = NULL;
+  boolean_t   optPartial    = FALSE;
+  const char  *optKext      = NULL;
+  const char  *optTar       = NULL;
+
+  FILE        *tarFile      = NULL;   // Kexts as one tar stream (-tar).
+  int         tarFd         = -1;     // The real stdout for -tar -, printf goes to stderr.
+
+  void        *indexBuffer  = NULL;   // Checkpoint index (-index), mapped or allocated.
+  size_t      indexSize     = 0;
+  boolean_t   indexMapped   = FALSE;
+
+  boolean_t   partialDecode = FALSE;  // Not all of the image was decoded (-partial, -index).
+
+  // Leading options.
+  while (argc > 2)
+  {
+    if (!strcmp (argv[1], "-j"))
+    {
+      optThreads = atoi (argv[2]);
+
+      if (optThreads < 1)
+      {
+        help ();
+        exit (ret);
+      }
+
+      argc -= 2;
+      argv += 2;
+    }
+    else if (!strcmp (argv[1], "-stream"))
+    {
+      optStream = TRUE;
+
+      argc--;
+      argv++;
+    }
+    else if (!strcmp (argv[1], "-decoder") || !strcmp (argv[1], "-encoder"))
+    {
+      if ((argv[1][1] == 'd') ? lzvn_select_decoder (argv[2]) : lzvn_select_encoder (argv[2]))
+      {
+        printf ("ERROR: Unknown or unsupported %s: %s\n", argv[1] + 1, argv[2]);
+        help ();
+        exit (ret);
+      }
+
+      argc -= 2;
+      argv += 2;
+    }
+    else if (!strcmp (argv[1], "-index"))
+    {
+      optIndex = argv[2];
+
+      argc -= 2;
+      argv += 2;
+    }
+    else if (!strcmp (argv[1], "-tar"))
+    {
+      optTar = argv[2];
+
+      argc -= 2;
+      argv += 2;
+    }
+    else if (!strcmp (argv[1], "-partial"))
+    {
+      optPartial = TRUE;
+
+      argc--;
+      argv++;
+    }
+    else if (!strcmp (argv[1], "-lzss"))
+    {
+      optLZSS = TRUE;
+
+      argc--;
+      argv++;
+    }
+    else if (!strcmp (argv[1], "-l"))
+    {
+      optLevel = atoi (argv[2]);
+
+      if ((optLevel < 1) || (optLevel > LZVN_MAX_LEVEL))
+      {
+        help ();
+        exit (ret);
+      }
+
+      argc -= 2;
+      argv += 2;
+    }
+    else
+    {
+      break;
+    }
+  }
 
   for (int i = 1; i < argc; ++i)
   {
@@ -119,6 +253,10 @@ int main (int argc, const char * argv[])
           {
             optList = TRUE;
           }
+          else if (!strcmp (argv[i], "-kext") && ((i + 1) < argc))
+          {
+            optKext = argv[++i];
+          }
           else {
             if (i == 3) {
               optOuput = argv[i];
@@ -148,17 +286,38 @@ int main (int argc, const char * argv[])
     || (optInput == NULL)
     || (optDecompress && (optArgsCount <= 2))
     || (optCompress && (optArgsCount <= 1))
+    || (optStream && (optOuput == NULL))
+    || (optStream && (optKernel || optDictionary || optKexts || optList || optKext))
+    || (optLZSS && (optDecompress || optStream || (optThreads > 0)))
+    || ((optLevel > 0) && (optDecompress || optStream))
+    || (optLZSS && (optLevel > LZSS_MAX_LEVEL))
+    || ((optIndex != NULL) && (!optDecompress || optStream))
+    || (optPartial && (!optDecompress || optStream || (optIndex != NULL) || (optOuput != NULL)))
+    || (optPartial && !(optKernel || optDictionary || optKexts || optList || optKext))
+    || ((optTar != NULL) && (!optDecompress || optStream || (optThreads > 0) || !(optKexts || optKext)))
     )
   {
     help ();
     exit (ret);
   }
 
+  // With -tar - the archive is the only thing on stdout, the progress messages go to stderr.
+  if ((optTar != NULL) && !strcmp (optTar, "-"))
+  {
+    fflush (stdout);
+
+    if (((tarFd = dup (STDOUT_FILENO)) < 0) || (dup2 (STDERR_FILENO, STDOUT_FILENO) < 0))
+    {
+      printf ("ERROR: Failed to redirect stdout\n");
+      exit (-1);
+    }
+  }
+
   //if (1) {
   //  exit (0);
   //}
 
-  if (optDecompress)
+  if (optDecompress && optStream)
   {
     fp = fopen (optInput, "rb");
 
@@ -167,208 +326,420 @@ int main (int argc, const char * argv[])
       printf ("ERROR: Open file %s\n", optInput);
       exit (ret);
     }
+
+    FILE *outFile = fopen (optOuput, "wb");
+
+    if (outFile == NULL)
+    {
+      printf ("ERROR: Open file %s\n", optOuput);
+      fclose (fp);
+      exit (ret);
+    }
+
+    printf ("Decoding prelinkedkernel ...\nWriting data to: %s\n", optOuput);
+
+    ret = decompressStream (fp, outFile);
+
+    // Buffered data is written here, so this can fail too.
+    if ((fclose (outFile) != 0) && (ret == 0))
+    {
+      printf ("ERROR: Failed to write %s\n", optOuput);
+      ret = -1;
+    }
+
+    fclose (fp);
+
+    if (ret == 0)
+    {
+      printf ("Done.\n");
+    }
     else
     {
-      fseek (fp, 0, SEEK_END);
+      // Don't leave a truncated file behind (as closeOutputFile () does).
+      unlink (optOuput);
+    }
+  }
 
-      fileLength = ftell (fp);
-      if (fileLength <= 0)
-      {
-        printf ("ERROR: Empty file\n");
-        fclose (fp);
-        exit (ret);
-      }
+  else if (optDecompress)
+  {
+    fileBuffer = mapInputFile (optInput, &inputLength);
 
-      printf ("Filesize: %ld bytes\n", fileLength);
+    if (fileBuffer == NULL)
+    {
+      exit (ret);
+    }
+    else
+    {
+      fileLength = inputLength;
 
-      fseek (fp, 0, SEEK_SET);
+      printf ("Filesize: %ld bytes\n", fileLength);
 
-      fileBuffer = malloc (fileLength);
-      if (fileBuffer == NULL)
-      {
-        printf ("ERROR: Failed to allocate file buffer\n");
-        fclose (fp);
-        exit (ret);
-      }
-      else
-      {
-        boolean_t compressed = FALSE;
+      boolean_t compressed = FALSE;
 
-        fread (fileBuffer, fileLength, 1, fp);
-        fclose (fp);
+      // Check for a FAT header.
+      fatHeader = (struct fat_header *)fileBuffer;
 
-        // Check for a FAT header.
-        fatHeader = (struct fat_header *)fileBuffer;
+      if ((fileLength >= sizeof (struct fat_header)) && (fatHeader->magic == FAT_CIGAM))
+      {
+        unsigned int i        = 0;
+        unsigned int fatCount = (unsigned int)((fileLength - sizeof (struct fat_header)) / sizeof (struct fat_arch));
 
-        if (fatHeader->magic == FAT_CIGAM)
+        // Only look at the fat_arch entries and slices that are in the file.
+        if (OSSwapInt32 (fatHeader->nfat_arch) < fatCount)
         {
-          unsigned int i = 1;
+          fatCount = OSSwapInt32 (fatHeader->nfat_arch);
+        }
 
-          fatArch       = (struct fat_arch *)(fileBuffer + sizeof (fatHeader));
-          prelinkHeader = (PrelinkedKernelHeader *)(unsigned char *)(fileBuffer + OSSwapInt32 (fatArch->offset));
+        fatArch       = (struct fat_arch *)(fileBuffer + sizeof (struct fat_header));
+        prelinkHeader = NULL;
 
-          while ((i < OSSwapInt32 (fatHeader->nfat_arch))
-            && (prelinkHeader->signature != OSSwapInt32 ('comp'))
-            )
+        while (i < fatCount)
+        {
+          if (((uint64_t)OSSwapInt32 (fatArch->offset) + sizeof (PrelinkedKernelHeader)) <= fileLength)
           {
-            printf ("Scanning ...\n");
-            fatArch = (struct fat_arch *)(unsigned char *)(fatArch + sizeof (fatArch));
             prelinkHeader = (PrelinkedKernelHeader *)(fileBuffer + OSSwapInt32 (fatArch->offset));
-            ++i;
-          }
 
-          // Is this a LZVN compressed file?
-          if ((prelinkHeader->compressType == OSSwapInt32 ('lzvn'))
-            || (prelinkHeader->compressType == OSSwapInt32 ('lzss'))
-            )
-          {
-            printf ("Prelinkedkernel found\n");
-          }
-          else
-          {
-            printf ("ERROR: Unsupported compression format detected\n");
-            ret = -1;
-            goto doneUncompress;
+            if (prelinkHeader->signature == OSSwapInt32 ('comp'))
+            {
+              break;
+            }
           }
+
+          printf ("Scanning ...\n");
+          fatArch++;
+          ++i;
+        }
+
+        if (prelinkHeader == NULL)
+        {
+          printf ("ERROR: Invalid FAT header\n");
+          ret = -1;
+          goto doneUncompress;
+        }
+
+        // Is this a LZVN compressed file?
+        if ((prelinkHeader->compressType == OSSwapInt32 ('lzvn'))
+          || (prelinkHeader->compressType == OSSwapInt32 ('lzss'))
+          )
+        {
+          printf ("Prelinkedkernel found\n");
+        }
+        else
+        {
+          printf ("ERROR: Unsupported compression format detected\n");
+          ret = -1;
+          goto doneUncompress;
+        }
+      }
+      else
+      {
+        prelinkHeader = (PrelinkedKernelHeader *)(unsigned char *)fileBuffer;
+      }
+
+      if ((fileLength >= sizeof (PrelinkedKernelHeader)) && (prelinkHeader->signature == OSSwapInt32 ('comp')))
+      {
+        compressed = TRUE;
+      }
+      else
+      {
+        workSpaceBuffer = fileBuffer;
+        workSpaceSize   = fileLength;
+      }
+
+      if (compressed)
+      {
+        if ((prelinkHeader->compressType == OSSwapInt32 ('lzvn'))
+          || (prelinkHeader->compressType == OSSwapInt32 ('lzss'))
+          )
+        {
+          workSpaceSize = OSSwapInt32 (prelinkHeader->uncompressedSize);
         }
         else
         {
-          prelinkHeader = (PrelinkedKernelHeader *)(unsigned char *)fileBuffer;
+          workSpaceSize = lzvn_encode_work_size ();
+        }
+
+        // printf ("workSpaceSize: %ld \n", workSpaceSize);
+
+        bufferSize = workSpaceSize;
+
+        // LZVN is decoded in place: the compressed data is read into the end
+        // of the output buffer, so the mapped input is not faulted in as well.
+        if ((workSpaceSize != 0) && (prelinkHeader->compressType == OSSwapInt32 ('lzvn')))
+        {
+          bufferSize += LZVN_IN_PLACE_MARGIN ((size_t)OSSwapInt32 (prelinkHeader->compressedSize));
+        }
+
+        // The dictionary and the list of kexts only need a few ranges, which
+        // an up to date index lets us decode without decoding everything.
+        if ((optIndex != NULL) && (prelinkHeader->compressType == OSSwapInt32 ('lzvn'))
+          && (optDictionary || optList) && !optKexts && !optKernel && (optOuput == NULL)
+          )
+        {
+          indexBuffer = loadIndex (optIndex, prelinkHeader, &indexSize);
+          indexMapped = (indexBuffer != NULL);
         }
 
-        if (prelinkHeader->signature == OSSwapInt32 ('comp'))
+        if (workSpaceSize == 0)
         {
-          compressed = TRUE;
+          workSpaceBuffer = NULL;
+        }
+        else if (indexMapped || (optPartial && (prelinkHeader->compressType == OSSwapInt32 ('lzvn'))))
+        {
+          // Zero filled, only the decoded ranges (or part) are ever touched.
+          bufferSize      = workSpaceSize;
+          workSpaceBuffer = calloc (1, workSpaceSize);
+        }
+        else if (optOuput != NULL)
+        {
+          // Decode straight into the mapped output file.
+          workSpaceBuffer = mapOutputFile (optOuput, bufferSize, &outputFd);
         }
         else
         {
-          workSpaceBuffer = fileBuffer;
-          workSpaceSize   = fileLength;
+          workSpaceBuffer = malloc (bufferSize);
         }
 
-        if (compressed)
+        if (workSpaceBuffer == NULL)
+        {
+          printf ("ERROR: Failed to allocate workSpaceBuffer\n");
+          ret = -1;
+          goto doneUncompress;
+        }
+        else
         {
-          if ((prelinkHeader->compressType == OSSwapInt32 ('lzvn'))
-            || (prelinkHeader->compressType == OSSwapInt32 ('lzss'))
-            )
+          tmpFileBuffer = (unsigned char *)prelinkHeader + sizeof (PrelinkedKernelHeader);
+
+          fileLength = OSSwapInt32 (prelinkHeader->compressedSize);
+
+          // The input is mapped at its exact size, don't read past it.
+          if ((size_t)(tmpFileBuffer - fileBuffer) + fileLength > inputLength)
           {
-            workSpaceSize = OSSwapInt32 (prelinkHeader->uncompressedSize);
+            printf ("ERROR: Compressed size exceeds the file\n");
+            ret = -1;
+            goto doneUncompress;
           }
-          else
+
+          if (prelinkHeader->compressType == OSSwapInt32 ('lzss'))
           {
-            workSpaceSize = lzvn_encode_work_size ();
+            compressedSize = decompress_lzss ((uint8_t *)workSpaceBuffer, workSpaceSize, (uint8_t *)tmpFileBuffer, fileLength, &buffer_adler32);
           }
-
-          // printf ("workSpaceSize: %ld \n", workSpaceSize);
-
-          if (workSpaceSize != 0)
+          else if (indexMapped)
           {
-            workSpaceBuffer = malloc (workSpaceSize);
+            printf ("index........: %s\n", optIndex);
+            compressedSize = decodeIndexedRanges (workSpaceBuffer, workSpaceSize, tmpFileBuffer, fileLength, indexBuffer, indexSize);
+            // Only the requested ranges are decoded, the adler32 in the index says nothing about them.
+            partialDecode = TRUE;
           }
-
-          if (workSpaceBuffer == NULL)
+          else if (optPartial)
           {
-            printf ("ERROR: Failed to allocate workSpaceBuffer\n");
-            ret = -1;
-            goto doneUncompress;
+            // Read from the mapped input, so only the part we decode is faulted in.
+            compressedSize = decodeProgressive (workSpaceBuffer, workSpaceSize, tmpFileBuffer, fileLength,
+                                                optKernel, (optDictionary || optList), optKexts, optKext);
+
+            if (compressedSize == workSpaceSize)
+            {
+              buffer_adler32 = lzvn_adler32 (buffer_adler32, workSpaceBuffer, compressedSize);
+            }
+            else if (compressedSize != 0)
+            {
+              printf ("Decoded %ld of %ld bytes\n", compressedSize, workSpaceSize);
+              partialDecode = TRUE;
+            }
           }
-          else
+          else if (optIndex != NULL)
           {
-            tmpFileBuffer = (unsigned char *)prelinkHeader + sizeof (PrelinkedKernelHeader);
+            // The resumable decoder stops at every checkpoint, and computes the adler32.
+            indexSize   = lzvn_index_size (workSpaceSize, LZVN_INDEX_SPACING);
+            indexBuffer = malloc (indexSize);
 
-            fileLength = OSSwapInt32 (prelinkHeader->compressedSize);
+            if (indexBuffer != NULL)
+            {
+              compressedSize = lzvn_decode_index (workSpaceBuffer, workSpaceSize, tmpFileBuffer, fileLength, indexBuffer, indexSize, LZVN_INDEX_SPACING);
+              buffer_adler32 = ((lzvn_index_header *)indexBuffer)->adler32;
+            }
 
-            if (prelinkHeader->compressType == OSSwapInt32 ('lzss'))
+            if ((compressedSize != 0) && (saveIndex (optIndex, indexBuffer, indexSize) != 0))
             {
-              compressedSize = decompress_lzss ((uint8_t *)workSpaceBuffer, workSpaceSize, (uint8_t *)tmpFileBuffer, fileLength);
+              ret = -1;
+              goto doneUncompress;
             }
-            else
+          }
+          else
+          {
+            // The adler32 is updated while decoding (asm/switch backends: in a second pass).
+            printf ("decoder......: %s\n", lzvn_decoder_name ());
+
+            if ((fileLength <= bufferSize)
+              && (readInputFile (optInput, (off_t)(tmpFileBuffer - fileBuffer), workSpaceBuffer + bufferSize - fileLength, fileLength) == 0)
+              )
             {
-              compressedSize = lzvn_decode (workSpaceBuffer, workSpaceSize, tmpFileBuffer, fileLength);
+              compressedSize = lzvn_decode_in_place (workSpaceBuffer, bufferSize, workSpaceSize, fileLength, &buffer_adler32);
             }
 
+            // Not from our encoder (needs a larger margin), or unreadable: decode from the mapped input.
             if (compressedSize == 0)
             {
-              printf ("ERROR: Decoding failed\n");
-              ret = -1;
-              goto doneUncompress;
+              buffer_adler32 = 1;
+              compressedSize = lzvn_decode_adler32 (workSpaceBuffer, workSpaceSize, tmpFileBuffer, fileLength, &buffer_adler32);
             }
           }
+
+          if (compressedSize == 0)
+          {
+            printf ("ERROR: Decoding failed\n");
+            ret = -1;
+            goto doneUncompress;
+          }
         }
+      }
 
-        // Are we unpacking a prelinkerkernel?
-        if (is_prelinkedkernel (workSpaceBuffer))
+      // Are we unpacking a prelinkerkernel?
+      if (is_prelinkedkernel (workSpaceBuffer))
+      {
+        printf ("Checking adler32 ... ");
+
+        // Yes. Compare with the adler32 computed while decoding.
+        if (compressed && !partialDecode
+          && (OSSwapInt32 (prelinkHeader->adler32) != buffer_adler32)
+          )
+        {
+          printf ("ERROR: Adler32 mismatch\n");
+          ret = -1;
+          goto doneUncompress;
+        }
+        else
         {
-          printf ("Checking adler32 ... ");
+          if (partialDecode)
+          {
+            // The rest of the image isn't decoded, so this can't be checked.
+            printf ("skipped (%s)\n", indexMapped ? "indexed ranges only" : "partial decode");
+          }
+          else
+          {
+            printf ("OK (0x%08x)\n", OSSwapInt32 (prelinkHeader->adler32));
+          }
+
+          if (optDictionary)
+          {
+            printf ("Extracting dictionary ...\n");
+
+            if (saveDictionary (workSpaceBuffer) != 0)
+            {
+              ret = -1;
+              goto doneUncompress;
+            }
+          }
 
-          // Yes. Check adler32.
-          if (compressed
-            && (OSSwapInt32 (prelinkHeader->adler32) != local_adler32 (workSpaceBuffer, workSpaceSize))
-            )
+          if ((optTar != NULL) && ((tarFile = ((tarFd >= 0) ? fdopen (tarFd, "wb") : fopen (optTar, "wb"))) == NULL))
           {
-            printf ("ERROR: Adler32 mismatch\n");
+            printf ("ERROR: Failed to open tar file: %s\n", optTar);
             ret = -1;
             goto doneUncompress;
           }
-          else
+
+          if (optKexts)
           {
-            printf ("OK (0x%08x)\n", OSSwapInt32 (prelinkHeader->adler32));
+            printf ("Extracting kexts ...\n");
+            optList = FALSE;
 
-            if (optDictionary)
+            if (listKexts (workSpaceBuffer, TRUE, NULL, optThreads, tarFile) != 0)
             {
-              printf ("Extracting dictionary ...\n");
-              saveDictionary (workSpaceBuffer);
+              ret = -1;
+              goto doneUncompress;
             }
+          }
+          else if (optKext)
+          {
+            printf ("Extracting kext %s ...\n", optKext);
 
-            if (optKexts)
+            if (listKexts (workSpaceBuffer, TRUE, optKext, optThreads, tarFile) != 0)
             {
-              printf ("Extracting kexts ...\n");
-              listKexts (workSpaceBuffer, TRUE);
-              optList = FALSE;
+              ret = -1;
+              goto doneUncompress;
             }
+          }
 
-            if (optList)
+          if (optList)
+          {
+            printf ("Getting list of kexts ...\n");
+
+            if (listKexts (workSpaceBuffer, FALSE, NULL, 0, NULL) != 0)
             {
-              printf ("Getting list of kexts ...\n");
-              listKexts (workSpaceBuffer, FALSE);
+              ret = -1;
+              goto doneUncompress;
             }
+          }
 
-            if (optKernel)
+          if (optKernel)
+          {
+            printf ("Extracting kernel ...\n");
+
+            if (saveKernel (workSpaceBuffer) != 0)
             {
-              printf ("Extracting kernel ...\n");
-              saveKernel (workSpaceBuffer);
+              ret = -1;
+              goto doneUncompress;
             }
+          }
 
-            if (compressed && (optOuput != NULL))
+          if (compressed && (optOuput != NULL))
+          {
+            printf ("Decoding prelinkedkernel ...\nWriting data to: %s\n", optOuput);
+
+            if (closeOutputFile (optOuput, workSpaceBuffer, bufferSize, compressedSize, outputFd) != 0)
             {
-              fp = fopen (optOuput, "wb");
-              printf ("Decoding prelinkedkernel ...\nWriting data to: %s\n", optOuput);
-              fwrite (workSpaceBuffer, 1, compressedSize, fp);
-              printf ("%ld bytes written\n", ftell (fp));
-              fclose (fp);
+              outputFd = -1;
+              ret = -1;
+              goto doneUncompress;
             }
 
-            printf ("Done.\n");
-            ret = 0;
-            goto doneUncompress;
+            outputFd = -1;
+            printf ("%ld bytes written\n", compressedSize);
           }
+
+          printf ("Done.\n");
+          ret = 0;
+          goto doneUncompress;
         }
+      }
 
-        printf ("ERROR: Unsupported format detected\n");
-        ret = -1;
+      printf ("ERROR: Unsupported format detected\n");
+      ret = -1;
 
-        doneUncompress:
+      doneUncompress:
 
-        if (compressed && (workSpaceBuffer != NULL)) {
-          free (workSpaceBuffer);
+      if (tarFile != NULL) {
+        // fclose flushes, so check both (and close it either way).
+        boolean_t tarError = ferror (tarFile);
+
+        if ((fclose (tarFile) != 0) || tarError) {
+          printf ("ERROR: Failed to write tar file: %s\n", optTar);
+          ret = -1;
         }
+      }
+      else if (tarFd >= 0) {
+        close (tarFd);
+      }
+
+      if (outputFd >= 0) {
+        closeOutputFile (optOuput, workSpaceBuffer, bufferSize, 0, outputFd);
+      }
+      else if (compressed && (optOuput == NULL) && (workSpaceBuffer != NULL)) {
+        free (workSpaceBuffer);
+      }
 
-        free (fileBuffer);
+      if (indexMapped) {
+        munmap (indexBuffer, indexSize);
+      }
+      else {
+        free (indexBuffer);
       }
+
+      munmap (fileBuffer, inputLength);
     }
   }
 
-  else if (optCompress)
+  else if (optCompress && optStream)
   {
     fp = fopen (optInput, "rb");
 
@@ -377,143 +748,224 @@ int main (int argc, const char * argv[])
       printf ("ERROR: Open file %s\n", optInput);
       exit (ret);
     }
+
+    FILE *outFile = fopen (optOuput, "wb");
+
+    if (outFile == NULL)
+    {
+      printf ("ERROR: Open file %s\n", optOuput);
+      fclose (fp);
+      exit (ret);
+    }
+
+    ret = compressStream (fp, outFile);
+
+    // Buffered data is written here, so this can fail too.
+    if ((fclose (outFile) != 0) && (ret == 0))
+    {
+      printf ("ERROR: Failed to write %s\n", optOuput);
+      ret = -1;
+    }
+
+    fclose (fp);
+
+    if (ret == 0)
+    {
+      printf ("Done.\n");
+    }
     else
     {
-      fseek (fp, 0, SEEK_END);
+      // Don't leave a truncated file behind (as closeOutputFile () does).
+      unlink (optOuput);
+    }
+  }
 
-      fileLength = ftell (fp);
-      if (fileLength <= 0) {
-        printf ("ERROR: Empty file\n");
-        fclose (fp);
-        exit (ret);
-      }
+  else if (optCompress)
+  {
+    fileBuffer = mapInputFile (optInput, &inputLength);
+
+    if (fileBuffer == NULL)
+    {
+      exit (ret);
+    }
+    else
+    {
+      fileLength = inputLength;
 
       printf ("fileLength...: %ld/0x%08lx - %s\n", fileLength, fileLength, optInput);
 
-      fseek (fp, 0, SEEK_SET);
+      void * workSpace = NULL;
 
-      fileBuffer = malloc (fileLength);
-      if (fileBuffer == NULL)
+      // Check for a FAT header, and encode only the first slice.
+      fatHeader = (struct fat_header *)fileBuffer;
+
+      if ((fileLength >= sizeof (struct fat_header)) && (fatHeader->magic == FAT_CIGAM))
       {
-        printf ("ERROR: Failed to allocate file buffer\n");
-        fclose (fp);
-        exit (ret);
+        fatArch = (struct fat_arch *)(fileBuffer + sizeof (struct fat_header));
+
+        if ((fileLength < (sizeof (struct fat_header) + sizeof (struct fat_arch)))
+          || ((uint64_t)OSSwapInt32 (fatArch->offset) + OSSwapInt32 (fatArch->size) > fileLength)
+          )
+        {
+          printf ("ERROR: Invalid FAT header\n");
+          ret = -1;
+          goto doneCompress;
+        }
+
+        offset      = OSSwapInt32 (fatArch->offset);
+        fileLength  = OSSwapInt32 (fatArch->size);
+
+        printf ("fat slice....: %ld/0x%08lx at 0x%08x\n", fileLength, fileLength, offset);
+      }
+
+      tmpFileBuffer = (unsigned char *)fileBuffer + offset;
+
+      // Output buffer, large enough for incompressible data (allocated once).
+      workSpaceSize = optLZSS ? LZSS_ENCODE_BOUND (fileLength) : lzvn_encode_bound (fileLength);
+
+      // Hash table for the given level.
+      size_t tableSize = ((optLevel > 0) && !optLZSS) ? lzvn_encode_level_work_size (fileLength, optLevel) : lzvn_encode_work_size_for (fileLength);
+
+      if (tableSize != 0) {
+        workSpace = malloc (tableSize);
+      }
+
+      if (workSpace == NULL)
+      {
+        printf ("ERROR: Failed to allocate workspace\n");
+        ret = -1;
+        goto doneCompress;
       }
       else
       {
-        void * workSpace = NULL;
+        printf ("workSpaceSize: %ld/0x%08lx\n", tableSize, tableSize);
 
-        fread(fileBuffer, fileLength, 1, fp);
-        fclose (fp);
-
-        size_t workSpaceSize = lzvn_encode_work_size();
+        if (workSpaceSize == 0) {
+          workSpaceBuffer = NULL;
+        }
+        else if (optOuput != NULL)
+        {
+          // Encode straight into the mapped output file, after the header.
+          outputBuffer = mapOutputFile (optOuput, sizeof (gFileHeader) + workSpaceSize, &outputFd);
 
-        if (workSpaceSize != 0) {
-          workSpace = malloc (workSpaceSize);
+          if (outputBuffer != NULL) {
+            workSpaceBuffer = outputBuffer + sizeof (gFileHeader);
+          }
+        }
+        else {
+          workSpaceBuffer = (void *)malloc (workSpaceSize);
         }
 
-        if (workSpace == NULL)
+        if (workSpaceBuffer == NULL)
         {
-          printf ("ERROR: Failed to allocate workspace\n");
+          printf ("ERROR: Failed to allocate workSpaceBuffer\n");
           ret = -1;
           goto doneCompress;
         }
         else
         {
-          printf ("workSpaceSize: %ld/0x%08lx\n", workSpaceSize, workSpaceSize);
-
-          if (fileLength > workSpaceSize)
+          if (is_prelinkedkernel (tmpFileBuffer))
           {
-            workSpaceSize = fileLength;
-          }
+            file_adler32 = local_adler32 (tmpFileBuffer, fileLength);
+            printf ("adler32......: 0x%08lx\n", file_adler32);
 
-          if (workSpaceSize != 0) {
-            workSpaceBuffer = (void *)malloc (workSpaceSize);
-          }
-
-          if (workSpaceBuffer == NULL)
-          {
-            printf ("ERROR: Failed to allocate workSpaceBuffer\n");
-            ret = -1;
-            goto doneCompress;
-          }
-          else
-          {
-            // Check for a FAT header.
-            fatHeader = (struct fat_header *)fileBuffer;
+            size_t outSize = 0;
 
-            if (fatHeader->magic == FAT_CIGAM)
+            if (optLZSS)
             {
-              fatArch = (struct fat_arch *)(fileBuffer + sizeof (fatHeader));
-              offset = OSSwapInt32 (fatArch->offset);
-            }
-
-            tmpFileBuffer = (unsigned char *)fileBuffer + offset;
+              if (optLevel == 0)
+              {
+                optLevel = LZSS_DEFAULT_LEVEL;
+              }
 
-            if (is_prelinkedkernel (tmpFileBuffer))
+              printf ("lzss level...: %d\n", optLevel);
+              outSize = lzss_encode (workSpaceBuffer, workSpaceSize, (u_int8_t *)tmpFileBuffer, (size_t)fileLength, optLevel);
+            }
+            else if (optThreads > 0)
             {
-              file_adler32 = local_adler32 (tmpFileBuffer, fileLength);
-              printf ("adler32......: 0x%08lx\n", file_adler32);
+              if (optLevel == 0)
+              {
+                optLevel = LZVN_DEFAULT_LEVEL;
+              }
 
-              size_t outSize = lzvn_encode (workSpaceBuffer, workSpaceSize, (u_int8_t *)tmpFileBuffer, (size_t)fileLength, workSpace);
-              printf ("outSize......: %ld/0x%08lx\n", outSize, outSize);
+              printf ("threads......: %d\n", optThreads);
+              printf ("lzvn level...: %d\n", optLevel);
+              outSize = lzvn_encode_parallel (workSpaceBuffer, workSpaceSize, (u_int8_t *)tmpFileBuffer, (size_t)fileLength, optThreads, optLevel);
+            }
+            else if (optLevel > 0)
+            {
+              printf ("lzvn level...: %d\n", optLevel);
+              outSize = lzvn_encode_level (workSpaceBuffer, workSpaceSize, (u_int8_t *)tmpFileBuffer, (size_t)fileLength, workSpace, optLevel);
+            }
+            else
+            {
+              printf ("encoder......: %s\n", lzvn_encoder_name ());
+              outSize = lzvn_encode (workSpaceBuffer, workSpaceSize, (u_int8_t *)tmpFileBuffer, (size_t)fileLength, workSpace);
+            }
 
-              if ((outSize != 0) && (optOuput != NULL))
-              {
-                bufend          = workSpaceBuffer + outSize;
-                compressedSize  = bufend - workSpaceBuffer;
+            printf ("outSize......: %ld/0x%08lx\n", outSize, outSize);
 
-                printf ("compressedSize.....: %ld/0x%08lx\n", compressedSize, compressedSize);
+            if ((outSize != 0) && (optOuput != NULL))
+            {
+              bufend          = workSpaceBuffer + outSize;
+              compressedSize  = bufend - workSpaceBuffer;
 
-                fp = fopen (optOuput, "wb");
+              printf ("compressedSize.....: %ld/0x%08lx\n", compressedSize, compressedSize);
 
-                printf ("Fixing file header for prelinkedkernel ...\n");
+              printf ("Fixing file header for prelinkedkernel ...\n");
 
-                // Inject arch offset into the header.
-                gFileHeader[5]  = OSSwapInt32 (sizeof (gFileHeader) + outSize - 28);
-                // Inject the value of file_adler32 into the header.
-                gFileHeader[9]  = OSSwapInt32 (file_adler32);
-                // Inject the uncompressed size into the header.
-                gFileHeader[10] = OSSwapInt32 (fileLength);
-                // Inject the compressed size into the header.
-                gFileHeader[11] = OSSwapInt32 (compressedSize);
+              // Inject arch offset into the header.
+              gFileHeader[5]  = OSSwapInt32 (sizeof (gFileHeader) + outSize - 28);
+              // Inject the compression type into the header.
+              gFileHeader[8]  = optLZSS ? OSSwapInt32 ('lzss') : OSSwapInt32 ('lzvn');
+              // Inject the value of file_adler32 into the header.
+              gFileHeader[9]  = OSSwapInt32 (file_adler32);
+              // Inject the uncompressed size into the header.
+              gFileHeader[10] = OSSwapInt32 (fileLength);
+              // Inject the compressed size into the header.
+              gFileHeader[11] = OSSwapInt32 (compressedSize);
 
-                printf ("Writing fixed up file header ...\n");
+              printf ("Writing fixed up file header ...\n");
 
-                fwrite (gFileHeader, (sizeof (gFileHeader) / sizeof (u_int32_t)), 4, fp);
+              memcpy (outputBuffer, gFileHeader, sizeof (gFileHeader));
 
-                printf ("Writing workspace buffer ...\n");
+              // The encoded data is already in place, just trim the file.
+              ret = closeOutputFile (optOuput, outputBuffer, sizeof (gFileHeader) + workSpaceSize, sizeof (gFileHeader) + outSize, outputFd);
 
-                fwrite (workSpaceBuffer, outSize, 1, fp);
-                fclose (fp);
+              outputFd        = -1;
+              workSpaceBuffer = NULL;
 
+              if (ret == 0) {
                 printf ("Done.\n");
-                ret = 0;
-                goto doneCompress;
               }
 
-              printf ("ERROR: Encoding failed\n");
-              ret = -1;
               goto doneCompress;
             }
+
+            printf ("ERROR: Encoding failed\n");
+            ret = -1;
+            goto doneCompress;
           }
         }
+      }
 
-        printf ("ERROR: Unsupported format detected\n");
-        ret = -1;
-
-        doneCompress:
+      printf ("ERROR: Unsupported format detected\n");
+      ret = -1;
 
-        if (workSpace != NULL) {
-          free (workSpace);
-        }
+      doneCompress:
 
-        if (workSpaceBuffer != NULL) {
-          free (workSpaceBuffer);
-        }
+      if (workSpace != NULL) {
+        free (workSpace);
+      }
 
-        free (fileBuffer);
+      if (outputFd >= 0) {
+        closeOutputFile (optOuput, outputBuffer, sizeof (gFileHeader) + workSpaceSize, 0, outputFd);
       }
+      else if (workSpaceBuffer != NULL) {
+        free (workSpaceBuffer);
+      }
+
+      munmap (fileBuffer, inputLength);
     }
   }
 
@@ -19,23 +19,30 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <limits.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 #include <unistd.h>
 
 #include <mach-o/fat.h>
 #include <mach-o/loader.h>
 #include <mach/machine.h>
-#include <mach/machine/boolean.h>
+#include <mach/boolean.h>
 
 #include <architecture/byte_order.h>
 
-#include <CoreFoundation/CoreFoundation.h>
-#include <IOKit/IOCFUnserialize.h>
-
 #include "FastCompression.h"
 #include "prelink.h"
+#include "C/plist.h"
+
+#define kBundleIdentifierKey  "CFBundleIdentifier"
+#define kBundleExecutableKey  "CFBundleExecutable"
 
 /*
  * Copied from: kext_tools/kext_tools-326.95.1/kernelcache.h
@@ -76,39 +83,30 @@ static u_int32_t gFileHeader[ 103 ] =
 };
 
 /*==============================================================================
- * Copied from: kext_tools/kext_tools-326.95.1/kernelcache.c
+ * Same result as local_adler32_update() in kext_tools/kernelcache.c, but
+ * computed by the SSSE3/AVX2 kernels in C/adler32.c (picked at runtime).
  */
 
 u_int32_t
-local_adler32 (
+local_adler32_update (
+  u_int32_t aAdler32,
   u_int8_t  *aBuffer,
   int32_t   aLength
   )
 {
-  int32_t     cnt;
-  u_int32_t   result, lowHalf, highHalf;
-
-  lowHalf   = 1;
-  highHalf  = 0;
-
-  for (cnt = 0; cnt < aLength; cnt++)
-  {
-    if ((cnt % 5000) == 0)
-    {
-      lowHalf  %= 65521L;
-      highHalf %= 65521L;
-    }
-
-    lowHalf += aBuffer[cnt];
-    highHalf += lowHalf;
-  }
+  return lzvn_adler32 (aAdler32, aBuffer, (aLength > 0) ? (size_t)aLength : 0);
+}
 
-  lowHalf  %= 65521L;
-  highHalf %= 65521L;
 
-  result = (highHalf << 16) | lowHalf;
+//==============================================================================
 
-  return result;
+u_int32_t
+local_adler32 (
+  u_int8_t  *aBuffer,
+  int32_t   aLength
+  )
+{
+  return local_adler32_update (1, aBuffer, aLength);
 }
 
 /**************************************************************
@@ -133,60 +131,153 @@ local_adler32 (
 #define F           (18)    /* upper limit for match_length */
 #define THRESHOLD   (2)     /* encode string into position and length */
 
+/*
+ * The decoder below does not keep the N byte ring buffer (text_buf) of the
+ * original: a ring position is turned into a distance back into the output,
+ * which then serves as the window. Positions before the start of the output
+ * read as ' ' (the preset of text_buf). Groups of 8 items are decoded without
+ * bounds checks while there is room for 8 maximum length matches, otherwise
+ * the per-byte checks of the original are used. The output is identical.
+ */
+
+//==============================================================================
+
+void
+lzss_copy_match (
+  uint8_t   *aDstStart,
+  uint8_t   *aDst,
+  size_t    aDistance,
+  size_t    aLength
+  )
+{
+  size_t    pos = (size_t)(aDst - aDstStart);
+  size_t    k;
+
+  for (k = 0; k < aLength; k++)
+  {
+    aDst[k] = ((pos + k) < aDistance) ? ' ' : aDst[k - aDistance];
+  }
+}
+
+
+//==============================================================================
+
 size_t
 decompress_lzss (
   uint8_t   *aDst,
   size_t    aDstlen,
   uint8_t   *aSrc,
-  size_t    aSrclen
+  size_t    aSrclen,
+  u_int32_t *aAdler32   /* optional: updated per LZVN_ADLER32_SPAN bytes of output */
   )
 {
-  /* ring buffer of size N, with extra F-1 bytes to aid string comparison */
-  uint8_t         text_buf[N + F - 1];
   uint8_t         *dststart = aDst;
+  uint8_t         *checked  = aDst;
   const uint8_t   *dstend   = aDst + aDstlen;
   const uint8_t   *srcend   = aSrc + aSrclen;
-  int             i, j, k, r, c;
-  unsigned int    flags;
+  const uint8_t   *ref;
+  size_t          distance, length, k;
+  unsigned int    flags, bit;
 
-  aDst = dststart;
-  for (i = 0; i < N - F; i++)
+  while (aSrc < srcend)
   {
-    text_buf[i] = ' ';
-  }
+    if (aAdler32 && ((aDst - checked) >= LZVN_ADLER32_SPAN))
+    {
+      *aAdler32 = lzvn_adler32 (*aAdler32, checked, aDst - checked);
+      checked   = aDst;
+    }
 
-  r     = N - F;
-  flags = 0;
+    flags = *aSrc++;
 
-  for ( ; ; ) {
-    if (((flags >>= 1) & 0x100) == 0)
-    {
-      if (aSrc < srcend) c = *aSrc++; else break;
-      flags = c | 0xFF00;  /* uses higher byte cleverly */
-    }   /* to count eight */
-    if (flags & 1)
+    // Fast path: room for 8 matches (2 input bytes, F output bytes each) plus 8 bytes of slack.
+    if (((srcend - aSrc) >= 16) && ((dstend - aDst) >= ((8 * F) + 8)))
     {
-      if (aSrc < srcend) c = *aSrc++; else break;
-      if (aDst < dstend) *aDst++ = c; else break;
-      text_buf[r++] = c;
-      r &= (N - 1);
+      for (bit = 0; bit < 8; bit++, flags >>= 1)
+      {
+        if (flags & 1)
+        {
+          *aDst++ = *aSrc++;
+          continue;
+        }
+
+        // Ring position -> distance (1..N) from the current output position.
+        distance = ((N - F) + (size_t)(aDst - dststart) - (aSrc[0] | ((aSrc[1] & 0xF0) << 4))) & (N - 1);
+        distance = distance ? distance : N;
+        length   = (aSrc[1] & 0x0F) + THRESHOLD + 1;
+        aSrc     += 2;
+
+        if (distance <= (size_t)(aDst - dststart))
+        {
+          ref = aDst - distance;
+
+          if (distance >= 8)
+          {
+            for (k = 0; k < length; k += 8)
+            {
+              memcpy (aDst + k, ref + k, 8);
+            }
+          }
+          else
+          {
+            for (k = 0; k < length; k++)
+            {
+              aDst[k] = ref[k];
+            }
+          }
+        }
+        else
+        {
+          lzss_copy_match (dststart, aDst, distance, length);
+        }
+
+        aDst += length;
+      }
+
+      continue;
     }
-    else
+
+    // Close to the end of either buffer.
+    for (bit = 0; bit < 8; bit++, flags >>= 1)
     {
-      if (aSrc < srcend) i = *aSrc++; else break;
-      if (aSrc < srcend) j = *aSrc++; else break;
-      i |= ((j & 0xF0) << 4);
-      j  =  (j & 0x0F) + THRESHOLD;
-      for (k = 0; k <= j; k++)
+      if (flags & 1)
+      {
+        if ((aSrc >= srcend) || (aDst >= dstend))
+        {
+          goto done;
+        }
+
+        *aDst++ = *aSrc++;
+      }
+      else
       {
-        c = text_buf[(i + k) & (N - 1)];
-        if (aDst < dstend) *aDst++ = c; else break;
-        text_buf[r++] = c;
-        r &= (N - 1);
+        if ((srcend - aSrc) < 2)
+        {
+          goto done;
+        }
+
+        distance = ((N - F) + (size_t)(aDst - dststart) - (aSrc[0] | ((aSrc[1] & 0xF0) << 4))) & (N - 1);
+        distance = distance ? distance : N;
+        length   = (aSrc[1] & 0x0F) + THRESHOLD + 1;
+        aSrc     += 2;
+
+        if (length > (size_t)(dstend - aDst))
+        {
+          length = (size_t)(dstend - aDst);
+        }
+
+        lzss_copy_match (dststart, aDst, distance, length);
+        aDst += length;
       }
     }
   }
 
+done:
+
+  if (aAdler32)
+  {
+    *aAdler32 = lzvn_adler32 (*aAdler32, checked, aDst - checked);
+  }
+
   return (size_t)(aDst - dststart);
 }
 
@@ -383,15 +474,99 @@ saveKernel (
   prelinkInfoSection->size      = 0;
   prelinkInfoSection->offset    = prelinkInfoSegment->fileoff;
 
-  FILE *fp = fopen ("kernel", "wb");
-  fwrite (aFileBuffer + delta, 1, (long)(linkeditSegment->fileoff + linkeditSegment->filesize), fp);
-  printf ("%ld bytes written\n", ftell (fp));
-  fclose (fp);
+  size_t  kernelSize  = (size_t)(linkeditSegment->fileoff + linkeditSegment->filesize);
+  FILE    *fp         = fopen ("kernel", "wb");
+
+  if (fp == NULL)
+  {
+    printf ("ERROR: Open file kernel\n");
+    return -1;
+  }
+
+  boolean_t failed = (fwrite (aFileBuffer + delta, 1, kernelSize, fp) != kernelSize);
+
+  if ((fclose (fp) != 0) || failed)
+  {
+    printf ("ERROR: Failed to write kernel\n");
+    unlink ("kernel");
+    return -1;
+  }
+
+  printf ("%ld bytes written\n", kernelSize);
+
+  return 0;
+}
+
+
+//==============================================================================
+// Parses __PRELINK_INFO (in place, see C/plist.c) as far as the start of the
+// _PrelinkInfoDictionary array. Call plist_free () when done.
+
+int
+openPrelinkInfo (
+  unsigned char               *aFileBuffer,
+  struct segment_command_64   *aPrelinkInfoSegment,
+  plist_parser                *aParser,
+  plist_value                 *aKextPlistArray
+  )
+{
+  plist_value prelinkInfoPlist;
+
+  plist_init (aParser, (const char *)aFileBuffer + aPrelinkInfoSegment->fileoff, aPrelinkInfoSegment->filesize);
+
+  if ((plist_root (aParser, &prelinkInfoPlist) != 1)
+    || (plist_dict_get (aParser, &prelinkInfoPlist, kPrelinkInfoDictionaryKey, aKextPlistArray) != 1)
+    || (aKextPlistArray->type != PLIST_ARRAY)
+    )
+  {
+    plist_free (aParser);
+    return -1;
+  }
 
   return 0;
 }
 
 
+//==============================================================================
+
+boolean_t
+getKextString (
+  plist_parser    *aParser,
+  plist_value     *aKextPlist,
+  const char      *aKey,
+  char            *aBuffer,
+  size_t          aSize
+  )
+{
+  plist_value value;
+
+  if ((plist_dict_get (aParser, aKextPlist, aKey, &value) != 1) || (value.type != PLIST_STRING))
+  {
+    return FALSE;
+  }
+
+  plist_string (&value, aBuffer, aSize);
+
+  return TRUE;
+}
+
+
+//==============================================================================
+
+boolean_t
+getKextNumber (
+  plist_parser    *aParser,
+  plist_value     *aKextPlist,
+  const char      *aKey,
+  uint64_t        *aNumber
+  )
+{
+  plist_value value;
+
+  return ((plist_dict_get (aParser, aKextPlist, aKey, &value) == 1) && plist_integer (&value, aNumber));
+}
+
+
 //==============================================================================
 
 uint8_t
@@ -414,30 +589,46 @@ saveDictionary (
     return -1;
   }
 
-  const char  *prelinkInfoBytes = (const char *)aFileBuffer + prelinkInfoSegment->fileoff;
+  plist_parser  parser;
+  plist_value   prelinkInfoPlist;
+  uint8_t       ret = -1;
 
-  CFPropertyListRef   prelinkInfoPlist = (CFPropertyListRef)IOCFUnserialize (prelinkInfoBytes, kCFAllocatorDefault, /* options */ 0, /* errorString */ NULL);
+  plist_init (&parser, (const char *)aFileBuffer + prelinkInfoSegment->fileoff, prelinkInfoSegment->filesize);
 
-  if (prelinkInfoPlist)
+  if (plist_root (&parser, &prelinkInfoPlist) != 1)
   {
-    printf ("NOTICE: Unserialized _PrelinkInfoDictionary\n");
+    printf ("ERROR: Can't parse _PrelinkInfoDictionary\n");
+    goto doneDictionary;
+  }
 
-    CFErrorRef  xmlError  = NULL;
-    CFDataRef   xmlData   = CFPropertyListCreateData (kCFAllocatorDefault, prelinkInfoPlist, kCFPropertyListXMLFormat_v1_0, 0, &xmlError);
+  printf ("NOTICE: Parsed _PrelinkInfoDictionary\n");
 
-    if (xmlError == NULL)
-    {
-      const unsigned char *buffer   = CFDataGetBytePtr (xmlData);
-      long                xmlLength = CFDataGetLength (xmlData);
+  FILE *fp = fopen ("Dictionary.plist", "w");
 
-      FILE *fp = fopen ("Dictionary.plist", "w");
-      fwrite (buffer, 1, xmlLength, fp);
-      printf ("%ld bytes written\n", ftell (fp));
-      fclose (fp);
-    }
+  if (fp == NULL)
+  {
+    printf ("ERROR: Open file Dictionary.plist\n");
+    goto doneDictionary;
   }
 
-  return 0;
+  boolean_t failed = (plist_write (&parser, &prelinkInfoPlist, fp) != 0);
+  long      length = ftell (fp);
+
+  if ((fclose (fp) != 0) || failed)
+  {
+    printf ("ERROR: Failed to convert/write Dictionary.plist\n");
+    unlink ("Dictionary.plist");
+    goto doneDictionary;
+  }
+
+  printf ("%ld bytes written\n", length);
+  ret = 0;
+
+doneDictionary:
+
+  plist_free (&parser);
+
+  return ret;
 }
 
 
@@ -465,7 +656,8 @@ _mkdir (
 
     if (stat (aDirectory, &sb) != 0)
     {
-      if (mkdir (aDirectory, aMode))
+      // EEXIST: created by another saveKexts () thread in the meantime.
+      if (mkdir (aDirectory, aMode) && (errno != EEXIST))
       {
         printf ("Error: cannot create directory: %s\n", aDirectory);
         return 1;
@@ -482,9 +674,9 @@ _mkdir (
   }
 
   // Create the final directory component.
-  if (stat (aDirectory, &sb) && mkdir (aDirectory, aMode))
+  if (stat (aDirectory, &sb) && mkdir (aDirectory, aMode) && (errno != EEXIST))
   {
-    printf ("Error: cannot create directory: %s", aDirectory);
+    printf ("Error: cannot create directory: %s\n", aDirectory);
     return 1;
   }
 
@@ -493,257 +685,1505 @@ _mkdir (
 
 
 //==============================================================================
+// A kext to save, worked out by listKexts () (the planning pass). saveKexts ()
+// only creates the directories and writes the files.
 
-uint8_t
-listKexts (
-  unsigned char   *aFileBuffer,
-  boolean_t       aSaveKexts
-  )
+typedef struct
 {
-  int signedKexts = 0;
-
-  struct segment_command_64     *textExecSegment    = NULL;
-  struct segment_command_64     *linkEditSegment    = NULL;
-  struct segment_command_64     *prelinkTextSegment   = NULL;
-  struct segment_command_64     *prelinkInfoSegment = NULL;
-  struct mach_header_64         *machHeader         = (struct mach_header_64 *)((unsigned char *)aFileBuffer);
-  struct linkedit_data_command  *codeSignature      = NULL;
-
-  if (machHeader->magic != MH_MAGIC_64)
-  {
-    printf ("ERROR: Invalid MachO header\n");
-    return -1;
-  }
+  char            *kextPath;              // kexts<_PrelinkBundlePath>, gets the Info.plist
+  char            *executableDirectory;   // <kextPath>/Contents/MacOS, or NULL
+  char            *executablePath;        // NULL without an executable
+  unsigned char   *executable;
+  uint64_t        executableSize;
+  plist_value     kextPlist;
+} KextSaveJob;
+
+typedef struct
+{
+  plist_parser    *parser;
+  KextSaveJob     **jobs;                 // Largest executable first.
+  long            jobCount;
+  long            nextJob;                // shared, taken with __sync_fetch_and_add
+  long            failed;                 // kexts not (completely) written, idem
+} KextSavePool;
 
-  uint32_t  delta = 0;
 
-  textExecSegment    = find_segment_64 (machHeader, "__TEXT_EXEC");
-  linkEditSegment    = find_segment_64 (machHeader, "__LINKEDIT");
-  prelinkTextSegment = find_segment_64 (machHeader, "__PRELINK_TEXT");
-  prelinkInfoSegment = find_segment_64 (machHeader, "__PRELINK_INFO");
+//==============================================================================
 
-  if (!linkEditSegment || !prelinkTextSegment || !prelinkInfoSegment)
-  {
-    printf ("ERROR: find_segment_64 (\"__LINKEDIT/__PRELINK_TEXT/__PRELINK_INFO\") failed\n");
-    return -1;
-  }
+void *
+saveKextWorker (
+  void  *aPool
+  )
+{
+  KextSavePool  *pool = (KextSavePool *)aPool;
+  KextSaveJob   *job  = NULL;
+  FILE          *fp   = NULL;
+  long          i     = 0;
+  boolean_t     failed;
+  boolean_t     written;
 
-  uint32_t  base = (uint32_t)(linkEditSegment->vmaddr - linkEditSegment->fileoff);
+  char          kextPlistPath[PATH_MAX];
 
-  if (textExecSegment)
+  while ((i = __sync_fetch_and_add (&pool->nextJob, 1)) < pool->jobCount)
   {
-    delta = textExecSegment->fileoff;
+    job     = pool->jobs[i];
+    failed  = FALSE;
 
-    machHeader = (struct mach_header_64 *)((unsigned char *)aFileBuffer + delta);
-    if (machHeader->magic != MH_MAGIC_64)
+    if (_mkdir (job->kextPath, 0755)
+      || (job->executableDirectory && _mkdir (job->executableDirectory, 0755))
+      )
     {
-      printf ("ERROR: Invalid MachO header\n");
-      return -1;
+      __sync_fetch_and_add (&pool->failed, 1);
+      continue;
     }
-  }
 
-  //printf ("delta: %u\n", delta);
-  //printf ("base: %u\n", base);
-
-  printf ("prelinkInfoSegment->vmaddr..: 0x%llx\n", prelinkInfoSegment->vmaddr);
-  printf ("prelinkInfoSegment->fileoff.: 0x%llx\n", prelinkInfoSegment->fileoff);
-  printf ("prelinkInfoSegment->filesize: 0x%llx\n", prelinkInfoSegment->filesize);
-
-  const char  *prelinkInfoBytes = (const char *)aFileBuffer + prelinkInfoSegment->fileoff;
-
-  CFPropertyListRef   prelinkInfoPlist = (CFPropertyListRef)IOCFUnserialize (prelinkInfoBytes, kCFAllocatorDefault, /* options */ 0, /* errorString */ NULL);
+    if (job->executablePath)
+    {
+      written = FALSE;
 
-  if (prelinkInfoPlist)
-  {
-    printf ("NOTICE: Unserialized prelink info\n");
+      if ((fp = fopen (job->executablePath, "w")) != NULL)
+      {
+        written = (fwrite (job->executable, 1, job->executableSize, fp) == job->executableSize);
 
-    CFArrayRef  kextPlistArray  = (CFArrayRef)CFDictionaryGetValue (prelinkInfoPlist, CFSTR ("_PrelinkInfoDictionary"));
-    CFIndex     i               = 0;
-    CFIndex     kextCount       = CFArrayGetCount(kextPlistArray);
+        // Also catches errors of buffered writes.
+        if (fclose (fp) != 0)
+        {
+          written = FALSE;
+        }
+      }
 
-    printf ("kextCount: %ld\n", kextCount);
+      if (!written)
+      {
+        printf ("ERROR: Failed to write %s\n", job->executablePath);
+        failed = TRUE;
+      }
+    }
 
-    char kextIdentifierBuffer[64];  // KMOD_MAX_NAME = 64
-    char kextBundlePathBuffer[PATH_MAX];
-    char kextPath[PATH_MAX];
-    char kextPlistPath[PATH_MAX];
-    char kextExecutablePath[PATH_MAX];
+    snprintf (kextPlistPath, sizeof (kextPlistPath), "%s/Info.plist", job->kextPath);
 
-    struct stat st = {0};
+    written = FALSE;
 
-    if (aSaveKexts)
+    if ((fp = fopen (kextPlistPath, "w")) != NULL)
     {
-      if (kextCount && (stat ("kexts", &st) == -1))
+      written = (plist_write (pool->parser, &job->kextPlist, fp) == 0);
+
+      if (fclose (fp) != 0)
       {
-        mkdir ("kexts", 0755);
+        written = FALSE;
       }
     }
 
-    for (i = 0; i < kextCount; i++)
+    if (!written)
     {
-      // printf ("kextPlist: 0x%llx\n", (int64_t)kextPlist - (int64_t)fileBuffer - prelinkInfoSegment->fileoff);
-      CFDictionaryRef   kextPlist = (CFDictionaryRef)CFArrayGetValueAtIndex (kextPlistArray, i);
+      printf ("ERROR: Failed to convert/write %s\n", kextPlistPath);
+      failed = TRUE;
+    }
 
-      if (aSaveKexts)
-      {
-        CFStringRef   kextIdentifier = (CFStringRef)CFDictionaryGetValue (kextPlist, kCFBundleIdentifierKey);
+    if (failed)
+    {
+      __sync_fetch_and_add (&pool->failed, 1);
+    }
+  }
 
-        if (kextIdentifier)
-        {
-          CFStringGetCString (kextIdentifier, kextIdentifierBuffer, sizeof (kextIdentifierBuffer), kCFStringEncodingUTF8);
-          printf ("\nCFBundleIdentifier[%3ld].......: %s\n", i, kextIdentifierBuffer);
-        }
-      }
+  return NULL;
+}
 
-      CFStringRef   bundlePath = (CFStringRef)CFDictionaryGetValue (kextPlist, CFSTR (kPrelinkBundlePathKey));
 
-      if (bundlePath)
-      {
-        CFStringGetCString (bundlePath, kextBundlePathBuffer, sizeof (kextBundlePathBuffer), kCFStringEncodingUTF8);
+//==============================================================================
 
-        if (aSaveKexts)
-        {
-          printf ("_PrelinkBundlePath............: %s\n", kextBundlePathBuffer);
+int
+compareKextSaveJobs (
+  const void  *a,
+  const void  *b
+  )
+{
+  uint64_t  aSize = (*(KextSaveJob **)a)->executableSize;
+  uint64_t  bSize = (*(KextSaveJob **)b)->executableSize;
 
-          sprintf (kextPath, "kexts%s", kextBundlePathBuffer);
-          printf ("kextPath......................: %s\n", kextPath);
+  return (aSize < bSize) ? 1 : ((aSize > bSize) ? -1 : 0);
+}
 
-          if (stat (kextPath, &st) == -1)
-          {
-            printf ("_mkdir (%s, 755)\n", kextPath);
-            _mkdir (kextPath, 0755);
-          }
-        }
-        else
-        {
-          printf ("%s\n", kextBundlePathBuffer);
-        }
-      }
 
-      if (aSaveKexts)
-      {
-        CFStringRef   executableRelativePath = (CFStringRef)CFDictionaryGetValue (kextPlist, CFSTR (kPrelinkExecutableRelativePathKey));
+//==============================================================================
+// Writes the kexts planned by listKexts () on aThreads threads (0 for one per
+// CPU), which take the next kext from a shared counter, the largest ones first.
+// Returns the number of kexts that failed.
 
-        if (executableRelativePath)
-        {
-          CFStringGetCString (executableRelativePath, kextBundlePathBuffer, sizeof (kextBundlePathBuffer), kCFStringEncodingUTF8);
+int
+saveKexts (
+  plist_parser    *aParser,
+  KextSaveJob     *aJobs,
+  long            aJobCount,
+  int             aThreads
+  )
+{
+  KextSavePool  pool;
+  pthread_t     *threads  = NULL;
+  int           created   = 1;
+  long          i         = 0;
 
-          printf ("_PrelinkExecutableRelativePath: %s\n", kextBundlePathBuffer);
+  memset (&pool, 0, sizeof (pool));
 
-          if (strncmp (kextBundlePathBuffer, "Contents/MacOS/", 15) == 0)
-          {
-            sprintf (kextExecutablePath, "%s/Contents/MacOS", kextPath);
-            printf ("kextExecutablePath............: %s\n", kextExecutablePath);
+  pool.parser   = aParser;
+  pool.jobCount = aJobCount;
+  pool.jobs     = malloc (aJobCount * sizeof (KextSaveJob *));
 
-            if (stat (kextExecutablePath, &st) == -1)
-            {
-              _mkdir (kextExecutablePath, 0755);
-              printf ("_mkdir (%s, 755)\n", kextExecutablePath);
-            }
-          }
-          else
-          {
-            sprintf (kextExecutablePath, "%s", kextPath);
-            printf ("kextExecutablePath............: %s\n", kextExecutablePath);
-          }
-        }
-      }
+  // All IDs are indexed now, after that the parser is only read.
+  if ((pool.jobs == NULL) || (plist_index_all (aParser) != 0))
+  {
+    free (pool.jobs);
+    return (int)aJobCount;
+  }
 
-      if (aSaveKexts)
-      {
-        CFStringRef executableName = (CFStringRef)CFDictionaryGetValue (kextPlist, kCFBundleExecutableKey);
+  for (i = 0; i < aJobCount; i++)
+  {
+    pool.jobs[i] = &aJobs[i];
+  }
 
-        if (executableName)
-        {
-          uint64_t  offset          = 0;
-          uint64_t  sourceAddress   = 0;
-          uint64_t  sourceSize      = 0;
+  qsort (pool.jobs, aJobCount, sizeof (KextSaveJob *), compareKextSaveJobs);
 
-          CFStringGetCString (executableName, kextIdentifierBuffer, sizeof (kextIdentifierBuffer), kCFStringEncodingUTF8);
-          printf ("CFBundleIdentifier............: %s\n", kextIdentifierBuffer);
+  if (aThreads < 1)
+  {
+    aThreads = (int)sysconf (_SC_NPROCESSORS_ONLN);
+  }
 
-          CFNumberRef kextSourceAddress = (CFNumberRef)CFDictionaryGetValue (kextPlist, CFSTR (kPrelinkExecutableSourceKey));
+  if (aThreads > aJobCount)
+  {
+    aThreads = (int)aJobCount;
+  }
 
-          if (kextSourceAddress)
-          {
-            CFNumberGetValue (kextSourceAddress, kCFNumberSInt64Type, &sourceAddress);
-            offset = ((uint32_t)sourceAddress - base - delta);
-            printf ("_PrelinkExecutableSourceAddr..: 0x%llx -> 0x%llx/%lld (offset)\n", sourceAddress, offset, offset);
-          }
+  if ((aThreads > 1) && ((threads = calloc (aThreads, sizeof (pthread_t))) != NULL))
+  {
+    // The calling thread is worker number 0, the others share what is left if pthread_create fails.
+    while ((created < aThreads) && (pthread_create (&threads[created], NULL, saveKextWorker, &pool) == 0))
+    {
+      created++;
+    }
+  }
 
-          CFNumberRef kextSourceSize = (CFNumberRef)CFDictionaryGetValue (kextPlist, CFSTR (kPrelinkExecutableSizeKey));
+  printf ("\nthreads......: %d\n", created);
 
-          if (kextSourceSize)
-          {
-            CFNumberGetValue (kextSourceSize, kCFNumberSInt64Type, &sourceSize);
-            printf ("_PrelinkExecutableSize........: 0x%llx/%lld\n", sourceSize, sourceSize);
-          }
+  saveKextWorker (&pool);
 
-          if (offset && sourceSize)
-          {
-            char            executablePath[PATH_MAX];
-            unsigned char   *buff = (unsigned char *)(aFileBuffer + offset + delta);
+  for (i = 1; i < created; i++)
+  {
+    pthread_join (threads[i], NULL);
+  }
 
-            machHeader = (struct mach_header_64 *)buff;
-            if (machHeader->magic != MH_MAGIC_64)
-            {
-              printf ("ERROR: Invalid MachO header\n");
-              return -1;
-            }
-            codeSignature = (struct linkedit_data_command *)find_load_command (machHeader, LC_CODE_SIGNATURE);
-            if (codeSignature)
-            {
-              printf ("Signed kext...................: Yes\n");
-              signedKexts++;
-            }
+  free (threads);
+  free (pool.jobs);
 
-            sprintf (executablePath, "%s/%s", kextExecutablePath, kextIdentifierBuffer);
-            printf ("executablePath................: %s\n", executablePath);
+  return (int)pool.failed;
+}
 
-            FILE *executable = fopen (executablePath, "w");
-            printf ("Magic ........................: %x\n", *(uint32_t *)machHeader);
-            fwrite (machHeader, 1, sourceSize, executable);
-            printf ("Executable....................: %s (%ld bytes written)\n", kextIdentifierBuffer, ftell (executable));
-            fclose (executable);
-          }
-        }
+
+//==============================================================================
+// Tar output (-tar <file | ->): every kext executable and Info.plist in one
+// sequential ustar stream, under the same paths as the kexts/ tree.
+
+#define TAR_BLOCK_SIZE  512
+
+typedef struct
+{
+  char  name[100];
+  char  mode[8];
+  char  uid[8];
+  char  gid[8];
+  char  size[12];
+  char  mtime[12];
+  char  checksum[8];
+  char  typeflag;
+  char  linkname[100];
+  char  magic[6];
+  char  version[2];
+  char  uname[32];
+  char  gname[32];
+  char  devmajor[8];
+  char  devminor[8];
+  char  prefix[155];
+  char  padding[12];
+} TarHeader;
+
+
+//==============================================================================
+// Returns 0 when written, 1 when aPath doesn't fit in name/prefix and -1 on a
+// write error.
+
+int
+writeTarHeader (
+  FILE        *aTar,
+  const char  *aPath,
+  uint64_t    aSize,
+  char        aType,
+  time_t      aTime
+  )
+{
+  TarHeader     header;
+  size_t        length    = strlen (aPath);
+  const char    *split    = NULL;
+  unsigned int  checksum  = 0;
+  size_t        i         = 0;
+
+  memset (&header, 0, sizeof (header));
+
+  if (length <= sizeof (header.name))
+  {
+    memcpy (header.name, aPath, length);
+  }
+  else
+  {
+    // Split at a slash into prefix (155) and name (100).
+    for (split = aPath + length - sizeof (header.name) - 1; (split = strchr (split, '/')) != NULL; split++)
+    {
+      if (((size_t)(split - aPath) <= sizeof (header.prefix)) && (split[1] != '\0'))
+      {
+        break;
+      }
+    }
+
+    if ((split == NULL) || ((size_t)(split - aPath) > sizeof (header.prefix)))
+    {
+      return 1;   // Doesn't fit, nothing written.
+    }
+
+    memcpy (header.prefix, aPath, split - aPath);
+    memcpy (header.name, split + 1, length - (split - aPath) - 1);
+  }
+
+  snprintf (header.mode, sizeof (header.mode), "%07o", 0644);
+  snprintf (header.uid, sizeof (header.uid), "%07o", 0);
+  snprintf (header.gid, sizeof (header.gid), "%07o", 0);
+  snprintf (header.size, sizeof (header.size), "%011llo", (unsigned long long)aSize);
+  snprintf (header.mtime, sizeof (header.mtime), "%011llo", (unsigned long long)aTime);
+  memset (header.checksum, ' ', sizeof (header.checksum));
+  header.typeflag = aType;
+  memcpy (header.magic, "ustar", 6);
+  memcpy (header.version, "00", 2);
+
+  for (i = 0; i < sizeof (header); i++)
+  {
+    checksum += ((unsigned char *)&header)[i];
+  }
+
+  snprintf (header.checksum, sizeof (header.checksum), "%06o", checksum);
+
+  return (fwrite (&header, 1, sizeof (header), aTar) == sizeof (header)) ? 0 : -1;
+}
+
+
+//==============================================================================
+// A file entry, with a pax header for the path when it doesn't fit in ustar.
+
+int
+writeTarFile (
+  FILE                  *aTar,
+  const char            *aPath,
+  const unsigned char   *aData,
+  uint64_t              aSize,
+  time_t                aTime
+  )
+{
+  static const char zeros[TAR_BLOCK_SIZE] = { 0 };
+  size_t            padding = (TAR_BLOCK_SIZE - (aSize % TAR_BLOCK_SIZE)) % TAR_BLOCK_SIZE;
+  int               status  = writeTarHeader (aTar, aPath, aSize, '0', aTime);
+
+  if (status == 1)
+  {
+    char    record[PATH_MAX + 32];
+    size_t  length = strlen (aPath) + 7;   // " path=" and "\n"
+    size_t  size   = 0;
+
+    // The record length includes its own digits.
+    size = (size_t)snprintf (NULL, 0, "%zu", length);
+    size = (size_t)snprintf (NULL, 0, "%zu", length + size) + length;
+    snprintf (record, sizeof (record), "%zu path=%s\n", size, aPath);
+
+    status = ((writeTarHeader (aTar, "PaxHeader", size, 'x', aTime) != 0)
+      || (fwrite (record, 1, size, aTar) != size)
+      || (fwrite (zeros, 1, (TAR_BLOCK_SIZE - (size % TAR_BLOCK_SIZE)) % TAR_BLOCK_SIZE, aTar) != (TAR_BLOCK_SIZE - (size % TAR_BLOCK_SIZE)) % TAR_BLOCK_SIZE)
+      || (writeTarHeader (aTar, "PaxFile", aSize, '0', aTime) != 0)
+      );
+  }
+
+  if (status != 0)
+  {
+    return -1;
+  }
+
+  if ((fwrite (aData, 1, aSize, aTar) != aSize) || (fwrite (zeros, 1, padding, aTar) != padding))
+  {
+    return -1;
+  }
+
+  return 0;
+}
+
+
+//==============================================================================
+// Writes the kexts planned by listKexts () to aTar, in order. The executables
+// come straight from the decoded buffer. Returns the number of kexts that failed.
+
+int
+saveKextsToTar (
+  plist_parser    *aParser,
+  KextSaveJob     *aJobs,
+  long            aJobCount,
+  FILE            *aTar
+  )
+{
+  static const char zeros[2 * TAR_BLOCK_SIZE] = { 0 };
+  time_t            now     = time (NULL);
+  char              *plist  = NULL;
+  size_t            size    = 0;
+  FILE              *fp     = NULL;
+  int               failed  = 0;
+  long              i       = 0;
+  boolean_t         written;
+
+  char              kextPlistPath[PATH_MAX];
+
+  // Fewer, larger writes.
+  setvbuf (aTar, NULL, _IOFBF, 1 << 20);
+
+  for (i = 0; i < aJobCount; i++)
+  {
+    KextSaveJob *job = &aJobs[i];
+
+    // The stream is sequential, there's no skipping past a failed write.
+    if (ferror (aTar))
+    {
+      failed += (int)(aJobCount - i);
+      break;
+    }
+
+    if (job->executablePath
+      && (writeTarFile (aTar, job->executablePath, job->executable, job->executableSize, now) != 0)
+      )
+    {
+      printf ("ERROR: Failed to write %s\n", job->executablePath);
+      failed++;
+      continue;
+    }
+
+    // The size goes in front of the data, so Info.plist is converted in memory.
+    snprintf (kextPlistPath, sizeof (kextPlistPath), "%s/Info.plist", job->kextPath);
+
+    written = FALSE;
+
+    if ((fp = open_memstream (&plist, &size)) != NULL)
+    {
+      written = (plist_write (aParser, &job->kextPlist, fp) == 0);
+
+      // Sets plist and size.
+      if (fclose (fp) != 0)
+      {
+        written = FALSE;
+      }
+    }
+
+    if (!written || (writeTarFile (aTar, kextPlistPath, (unsigned char *)plist, size, now) != 0))
+    {
+      printf ("ERROR: Failed to convert/write %s\n", kextPlistPath);
+      failed++;
+    }
+
+    free (plist);
+    plist = NULL;
+  }
+
+  // End of archive.
+  if ((fwrite (zeros, 1, sizeof (zeros), aTar) != sizeof (zeros)) || (fflush (aTar) != 0))
+  {
+    printf ("ERROR: Failed to write tar file\n");
+    failed = (int)aJobCount;
+  }
+
+  return failed;
+}
+
+
+//==============================================================================
+
+uint8_t
+listKexts (
+  unsigned char   *aFileBuffer,
+  boolean_t       aSaveKexts,
+  const char      *aBundleID,     // Only save this kext (-kext), or NULL for all.
+  int             aThreads,       // For saveKexts (), 0 for one per CPU.
+  FILE            *aTar           // Write a tar stream instead of the kexts/ tree, or NULL.
+  )
+{
+  int signedKexts = 0;
+
+  struct segment_command_64     *textExecSegment    = NULL;
+  struct segment_command_64     *linkEditSegment    = NULL;
+  struct segment_command_64     *prelinkTextSegment   = NULL;
+  struct segment_command_64     *prelinkInfoSegment = NULL;
+  struct mach_header_64         *machHeader         = (struct mach_header_64 *)((unsigned char *)aFileBuffer);
+  struct linkedit_data_command  *codeSignature      = NULL;
+
+  if (machHeader->magic != MH_MAGIC_64)
+  {
+    printf ("ERROR: Invalid MachO header\n");
+    return -1;
+  }
+
+  uint32_t  delta = 0;
+
+  textExecSegment    = find_segment_64 (machHeader, "__TEXT_EXEC");
+  linkEditSegment    = find_segment_64 (machHeader, "__LINKEDIT");
+  prelinkTextSegment = find_segment_64 (machHeader, "__PRELINK_TEXT");
+  prelinkInfoSegment = find_segment_64 (machHeader, "__PRELINK_INFO");
+
+  if (!linkEditSegment || !prelinkTextSegment || !prelinkInfoSegment)
+  {
+    printf ("ERROR: find_segment_64 (\"__LINKEDIT/__PRELINK_TEXT/__PRELINK_INFO\") failed\n");
+    return -1;
+  }
+
+  uint32_t  base = (uint32_t)(linkEditSegment->vmaddr - linkEditSegment->fileoff);
+
+  if (textExecSegment)
+  {
+    delta = textExecSegment->fileoff;
+
+    machHeader = (struct mach_header_64 *)((unsigned char *)aFileBuffer + delta);
+    if (machHeader->magic != MH_MAGIC_64)
+    {
+      printf ("ERROR: Invalid MachO header\n");
+      return -1;
+    }
+  }
+
+  //printf ("delta: %u\n", delta);
+  //printf ("base: %u\n", base);
+
+  printf ("prelinkInfoSegment->vmaddr..: 0x%llx\n", prelinkInfoSegment->vmaddr);
+  printf ("prelinkInfoSegment->fileoff.: 0x%llx\n", prelinkInfoSegment->fileoff);
+  printf ("prelinkInfoSegment->filesize: 0x%llx\n", prelinkInfoSegment->filesize);
+
+  plist_parser  parser;
+  plist_value   kextPlistArray;
+  plist_value   kextPlist;
+  const char    *cursor     = NULL;
+  long          i           = 0;
+  long          kextCount   = 0;
+  int           status      = 0;
+
+  if (openPrelinkInfo (aFileBuffer, prelinkInfoSegment, &parser, &kextPlistArray) != 0)
+  {
+    printf ("ERROR: Can't parse _PrelinkInfoDictionary\n");
+    return -1;
+  }
+
+  printf ("NOTICE: Parsed prelink info\n");
+
+  // Only skips over the kext dictionaries.
+  while (plist_next (&parser, &kextPlistArray, &cursor, NULL, &kextPlist) == 1)
+  {
+    kextCount++;
+  }
+
+  printf ("kextCount: %ld\n", kextCount);
+
+  char kextIdentifierBuffer[64];  // KMOD_MAX_NAME = 64
+  char kextBundlePathBuffer[PATH_MAX];
+  char kextPath[PATH_MAX];
+  char kextPlistPath[PATH_MAX];
+  char kextExecutablePath[PATH_MAX];
+
+  struct stat st = {0};
+
+  KextSaveJob *jobs       = NULL;
+  KextSaveJob *job        = NULL;
+  long        jobCount    = 0;
+  int         failedKexts = 0;
+  boolean_t   invalid     = FALSE;
+
+  if (aSaveKexts)
+  {
+    if (kextCount && (aTar == NULL) && (stat ("kexts", &st) == -1))
+    {
+      mkdir ("kexts", 0755);
+    }
+
+    if ((jobs = calloc (kextCount + 1, sizeof (KextSaveJob))) == NULL)
+    {
+      printf ("ERROR: Failed to allocate kext list\n");
+      plist_free (&parser);
+      return -1;
+    }
+  }
+
+  // Planning pass: each kext only looks up the keys it needs, nothing else is
+  // parsed. The directories and files are written by saveKexts () afterwards.
+  for (cursor = NULL, i = 0; (status = plist_next (&parser, &kextPlistArray, &cursor, NULL, &kextPlist)) == 1; i++)
+  {
+    if (aBundleID)
+    {
+      if (!getKextString (&parser, &kextPlist, kBundleIdentifierKey, kextIdentifierBuffer, sizeof (kextIdentifierBuffer))
+        || strcmp (kextIdentifierBuffer, aBundleID)
+        )
+      {
+        continue;
+      }
+    }
+
+    if (aSaveKexts)
+    {
+      if (getKextString (&parser, &kextPlist, kBundleIdentifierKey, kextIdentifierBuffer, sizeof (kextIdentifierBuffer)))
+      {
+        printf ("\nCFBundleIdentifier[%3ld].......: %s\n", i, kextIdentifierBuffer);
       }
+    }
 
+    if (getKextString (&parser, &kextPlist, kPrelinkBundlePathKey, kextBundlePathBuffer, sizeof (kextBundlePathBuffer)))
+    {
       if (aSaveKexts)
       {
-        CFErrorRef  xmlError  = NULL;
-        CFDataRef   xmlData   = CFPropertyListCreateData (kCFAllocatorDefault, kextPlist, kCFPropertyListXMLFormat_v1_0, 0, &xmlError);
+        printf ("_PrelinkBundlePath............: %s\n", kextBundlePathBuffer);
+
+        snprintf (kextPath, sizeof (kextPath), "kexts%s", kextBundlePathBuffer);
+        printf ("kextPath......................: %s\n", kextPath);
+
+        // Where the executable goes, unless _PrelinkExecutableRelativePath says otherwise.
+        strcpy (kextExecutablePath, kextPath);
+
+        job                 = &jobs[jobCount++];
+        job->kextPath       = strdup (kextPath);
+        job->kextPlist      = kextPlist;
+      }
+      else
+      {
+        printf ("%s\n", kextBundlePathBuffer);
+      }
+    }
+    else if (aSaveKexts)
+    {
+      printf ("ERROR: No %s, kext %ld skipped\n", kPrelinkBundlePathKey, i);
+      continue;
+    }
+
+    if (aSaveKexts)
+    {
+      if (getKextString (&parser, &kextPlist, kPrelinkExecutableRelativePathKey, kextBundlePathBuffer, sizeof (kextBundlePathBuffer)))
+      {
+        printf ("_PrelinkExecutableRelativePath: %s\n", kextBundlePathBuffer);
 
-        if (xmlError == NULL)
+        if (strncmp (kextBundlePathBuffer, "Contents/MacOS/", 15) == 0)
         {
-          const unsigned char   *buffer   = CFDataGetBytePtr (xmlData);
-          long                  xmlLength = CFDataGetLength (xmlData);
+          snprintf (kextExecutablePath, sizeof (kextExecutablePath), "%s/Contents/MacOS", kextPath);
+          job->executableDirectory = strdup (kextExecutablePath);
+        }
+
+        printf ("kextExecutablePath............: %s\n", kextExecutablePath);
+      }
+    }
+
+    if (aSaveKexts)
+    {
+      if (getKextString (&parser, &kextPlist, kBundleExecutableKey, kextIdentifierBuffer, sizeof (kextIdentifierBuffer)))
+      {
+        uint64_t  offset          = 0;
+        uint64_t  sourceAddress   = 0;
+        uint64_t  sourceSize      = 0;
 
-          sprintf (kextPlistPath, "%s/Info.plist", kextPath);
-          printf ("kextPlistPath.................: %s\n", kextPlistPath);
+        printf ("CFBundleIdentifier............: %s\n", kextIdentifierBuffer);
 
-          FILE *infoPlist = fopen (kextPlistPath, "w");
-          fwrite (buffer, 1, xmlLength, infoPlist);
-          printf ("Info.plist....................: %ld bytes written\n", ftell (infoPlist));
-          fclose (infoPlist);
+        if (getKextNumber (&parser, &kextPlist, kPrelinkExecutableSourceKey, &sourceAddress))
+        {
+          offset = ((uint32_t)sourceAddress - base - delta);
+          printf ("_PrelinkExecutableSourceAddr..: 0x%llx -> 0x%llx/%lld (offset)\n", sourceAddress, offset, offset);
         }
-        else
+
+        if (getKextNumber (&parser, &kextPlist, kPrelinkExecutableSizeKey, &sourceSize))
+        {
+          printf ("_PrelinkExecutableSize........: 0x%llx/%lld\n", sourceSize, sourceSize);
+        }
+
+        if (offset && sourceSize)
         {
-          printf ("ERROR: Failed to convert/write Info.plist\n");
+          char            executablePath[PATH_MAX];
+          unsigned char   *buff = (unsigned char *)(aFileBuffer + offset + delta);
+
+          machHeader = (struct mach_header_64 *)buff;
+          if (machHeader->magic != MH_MAGIC_64)
+          {
+            printf ("ERROR: Invalid MachO header\n");
+            invalid = TRUE;
+            break;
+          }
+          codeSignature = (struct linkedit_data_command *)find_load_command (machHeader, LC_CODE_SIGNATURE);
+          if (codeSignature)
+          {
+            printf ("Signed kext...................: Yes\n");
+            signedKexts++;
+          }
+
+          snprintf (executablePath, sizeof (executablePath), "%s/%s", kextExecutablePath, kextIdentifierBuffer);
+          printf ("executablePath................: %s\n", executablePath);
+          printf ("Magic ........................: %x\n", *(uint32_t *)machHeader);
+          printf ("Executable....................: %s (%lld bytes)\n", kextIdentifierBuffer, sourceSize);
+
+          job->executablePath = strdup (executablePath);
+          job->executable     = buff;
+          job->executableSize = sourceSize;
         }
       }
     }
 
     if (aSaveKexts)
     {
-      printf ("\n%ld kexts extracted (%d signed and %ld unsigned)\n", kextCount, signedKexts, (kextCount - signedKexts));
+      snprintf (kextPlistPath, sizeof (kextPlistPath), "%s/Info.plist", kextPath);
+      printf ("kextPlistPath.................: %s\n", kextPlistPath);
     }
   }
-  else
+
+  if (!invalid && (status == 0) && (jobCount > 0))
+  {
+    failedKexts = aTar ? saveKextsToTar (&parser, jobs, jobCount, aTar) : saveKexts (&parser, jobs, jobCount, aThreads);
+  }
+
+  for (i = 0; i < jobCount; i++)
+  {
+    free (jobs[i].kextPath);
+    free (jobs[i].executableDirectory);
+    free (jobs[i].executablePath);
+  }
+
+  free (jobs);
+  plist_free (&parser);
+
+  if (invalid)
+  {
+    return -1;
+  }
+
+  if (status < 0)
+  {
+    printf ("ERROR: Can't parse _PrelinkInfoDictionary\n");
+    return -1;
+  }
+
+  if (aBundleID && (jobCount == 0))
   {
-    printf ("ERROR: Can't unserialize _PrelinkInfoDictionary\n");
+    printf ("ERROR: Kext %s not found\n", aBundleID);
     return -1;
   }
 
+  if (failedKexts)
+  {
+    printf ("\nERROR: Failed to write %d of %ld kexts\n", failedKexts, jobCount);
+    return -1;
+  }
+
+  if (aSaveKexts)
+  {
+    printf ("\n%ld kexts extracted (%d signed and %ld unsigned)\n", jobCount, signedKexts, (jobCount - signedKexts));
+  }
+
   return 0;
 }
+
+
+//==============================================================================
+// Maps aPath copy-on-write, so callers can patch the buffer without touching
+// the file. Returns NULL on failure or for an empty file.
+
+unsigned char *
+mapInputFile (
+  const char  *aPath,
+  size_t      *aLength
+  )
+{
+  struct stat   st;
+  unsigned char *buffer = NULL;
+  int           fd      = open (aPath, O_RDONLY);
+
+  if (fd < 0)
+  {
+    printf ("ERROR: Open file %s\n", aPath);
+    return NULL;
+  }
+
+  if ((fstat (fd, &st) != 0) || (st.st_size <= 0))
+  {
+    printf ("ERROR: Empty file\n");
+    close (fd);
+    return NULL;
+  }
+
+  *aLength  = (size_t)st.st_size;
+  buffer    = mmap (NULL, *aLength, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+
+  close (fd);
+
+  if (buffer == MAP_FAILED)
+  {
+    printf ("ERROR: Failed to map file %s\n", aPath);
+    return NULL;
+  }
+
+  return buffer;
+}
+
+
+//==============================================================================
+// Reads aLength bytes at aOffset in aPath into aBuffer, without going through
+// (and faulting in) the input mapping. Returns 0 on success.
+
+int
+readInputFile (
+  const char    *aPath,
+  off_t         aOffset,
+  unsigned char *aBuffer,
+  size_t        aLength
+  )
+{
+  ssize_t bytesRead = 0;
+  int     fd        = open (aPath, O_RDONLY);
+
+  if (fd < 0)
+  {
+    printf ("ERROR: Open file %s\n", aPath);
+    return -1;
+  }
+
+  while (aLength > 0)
+  {
+    bytesRead = pread (fd, aBuffer, aLength, aOffset);
+
+    if (bytesRead <= 0)
+    {
+      printf ("ERROR: Failed to read file %s\n", aPath);
+      close (fd);
+      return -1;
+    }
+
+    aBuffer += bytesRead;
+    aOffset += bytesRead;
+    aLength -= bytesRead;
+  }
+
+  close (fd);
+
+  return 0;
+}
+
+
+//==============================================================================
+// Maps the checkpoint index written by lzvn -index, if there is one for this
+// prelinkedkernel (same sizes and adler32). Returns NULL otherwise.
+
+void *
+loadIndex (
+  const char              *aPath,
+  PrelinkedKernelHeader   *aPrelinkHeader,
+  size_t                  *aLength
+  )
+{
+  lzvn_index_header *header = NULL;
+
+  if (access (aPath, R_OK) != 0)
+  {
+    return NULL;
+  }
+
+  if ((header = (lzvn_index_header *)mapInputFile (aPath, aLength)) == NULL)
+  {
+    return NULL;
+  }
+
+  if ((*aLength < sizeof (lzvn_index_header))
+    || (header->magic != LZVN_INDEX_MAGIC)
+    || (header->src_size != OSSwapInt32 (aPrelinkHeader->compressedSize))
+    || (header->dst_size != OSSwapInt32 (aPrelinkHeader->uncompressedSize))
+    || (header->adler32 != OSSwapInt32 (aPrelinkHeader->adler32))
+    )
+  {
+    printf ("NOTICE: Index %s is for another file\n", aPath);
+    munmap (header, *aLength);
+    return NULL;
+  }
+
+  return header;
+}
+
+
+//==============================================================================
+
+int
+saveIndex (
+  const char    *aPath,
+  void          *aIndex,
+  size_t        aLength
+  )
+{
+  FILE *fp = fopen (aPath, "wb");
+
+  if (fp == NULL)
+  {
+    printf ("ERROR: Open file %s\n", aPath);
+    return -1;
+  }
+
+  boolean_t failed = (fwrite (aIndex, 1, aLength, fp) != aLength);
+
+  // Buffered data is written here, so this can fail too.
+  if ((fclose (fp) != 0) || failed)
+  {
+    printf ("ERROR: Failed to write index %s\n", aPath);
+    unlink (aPath);
+    return -1;
+  }
+
+  printf ("%ld bytes written to %s\n", aLength, aPath);
+
+  return 0;
+}
+
+
+//==============================================================================
+// Decodes, with the checkpoint index, only what saveDictionary() and listKexts()
+// without saving read: the Mach-O header and load commands, the header at
+// __TEXT_EXEC and the __PRELINK_INFO segment. aBuffer is zero filled and never
+// touched elsewhere, so the rest of it takes no memory. Returns aBufferSize on
+// success, 0 otherwise.
+
+size_t
+decodeIndexedRanges (
+  unsigned char   *aBuffer,
+  size_t          aBufferSize,
+  unsigned char   *aSrc,
+  size_t          aSrcSize,
+  void            *aIndex,
+  size_t          aIndexSize
+  )
+{
+  struct mach_header_64       *machHeader = (struct mach_header_64 *)aBuffer;
+  struct segment_command_64   *segment    = NULL;
+  size_t                      offset      = 0;
+  size_t                      length      = sizeof (struct mach_header_64);
+
+  if ((aBufferSize < length)
+    || (lzvn_decode_range (aBuffer, 0, length, aSrc, aSrcSize, aIndex, aIndexSize) != length)
+    )
+  {
+    return 0;
+  }
+
+  length += machHeader->sizeofcmds;
+
+  if ((length > aBufferSize)
+    || (lzvn_decode_range (aBuffer, 0, length, aSrc, aSrcSize, aIndex, aIndexSize) != length)
+    )
+  {
+    return 0;
+  }
+
+  if ((segment = find_segment_64 (machHeader, "__TEXT_EXEC")) != NULL)
+  {
+    offset = segment->fileoff;
+    length = sizeof (struct mach_header_64);
+
+    if ((offset > aBufferSize - length)
+      || (lzvn_decode_range (aBuffer + offset, offset, length, aSrc, aSrcSize, aIndex, aIndexSize) != length)
+      )
+    {
+      return 0;
+    }
+  }
+
+  if ((segment = find_segment_64 (machHeader, "__PRELINK_INFO")) == NULL)
+  {
+    return 0;
+  }
+
+  offset = segment->fileoff;
+  length = segment->filesize;
+
+  if ((offset > aBufferSize) || (length > aBufferSize - offset)
+    || (lzvn_decode_range (aBuffer + offset, offset, length, aSrc, aSrcSize, aIndex, aIndexSize) != length)
+    )
+  {
+    return 0;
+  }
+
+  return aBufferSize;
+}
+
+
+//==============================================================================
+// Looks up aBundleID in the _PrelinkInfoDictionary and returns the file offset
+// and size of its executable, the same way listKexts() finds it. Returns 0 when
+// there is no such kext (or it has no executable).
+
+uint8_t
+findKextExecutable (
+  unsigned char   *aFileBuffer,
+  const char      *aBundleID,
+  uint64_t        *aOffset,
+  uint64_t        *aSize
+  )
+{
+  uint8_t                     found               = 0;
+  struct mach_header_64       *machHeader         = (struct mach_header_64 *)aFileBuffer;
+  struct segment_command_64   *linkEditSegment    = find_segment_64 (machHeader, "__LINKEDIT");
+  struct segment_command_64   *prelinkInfoSegment = find_segment_64 (machHeader, "__PRELINK_INFO");
+
+  if (!linkEditSegment || !prelinkInfoSegment)
+  {
+    return 0;
+  }
+
+  uint32_t  base = (uint32_t)(linkEditSegment->vmaddr - linkEditSegment->fileoff);
+
+  plist_parser  parser;
+  plist_value   kextPlistArray;
+  plist_value   kextPlist;
+  const char    *cursor = NULL;
+  uint64_t      sourceAddress = 0;
+
+  char kextIdentifierBuffer[64];  // KMOD_MAX_NAME = 64
+
+  if (openPrelinkInfo (aFileBuffer, prelinkInfoSegment, &parser, &kextPlistArray) != 0)
+  {
+    return 0;
+  }
+
+  while (!found && (plist_next (&parser, &kextPlistArray, &cursor, NULL, &kextPlist) == 1))
+  {
+    if (getKextString (&parser, &kextPlist, kBundleIdentifierKey, kextIdentifierBuffer, sizeof (kextIdentifierBuffer))
+      && !strcmp (kextIdentifierBuffer, aBundleID)
+      && getKextNumber (&parser, &kextPlist, kPrelinkExecutableSourceKey, &sourceAddress)
+      && getKextNumber (&parser, &kextPlist, kPrelinkExecutableSizeKey, aSize)
+      )
+    {
+      // listKexts () reads it at aFileBuffer + (offset + delta).
+      *aOffset  = ((uint32_t)sourceAddress - base);
+      found     = 1;
+    }
+  }
+
+  plist_free (&parser);
+
+  return found;
+}
+
+
+//==============================================================================
+// Decodes up to aOffset bytes of output (progressive decoding, see below).
+// Returns 0 when the stream ends or is invalid before that.
+
+int
+decodeUntil (
+  lzvn_decoder_state  *aState,
+  size_t              aBufferSize,
+  uint64_t            aOffset
+  )
+{
+  if (aOffset > aBufferSize)
+  {
+    return 0;
+  }
+
+  if (aState->dst < aState->dst_begin + aOffset)
+  {
+    aState->dst_end = aState->dst_begin + aOffset;
+
+    if (lzvn_decoder_run (aState) < 0)
+    {
+      return 0;
+    }
+  }
+
+  return (aState->dst >= aState->dst_begin + aOffset);
+}
+
+
+//==============================================================================
+// Progressive decoding (-partial): decodes from the start of the image only
+// until everything the requested extraction reads is there. The load commands
+// are parsed as soon as they are decoded, to find out where that is:
+//
+//  - kernel:     the kernel at __TEXT_EXEC, up to the end of its __LINKEDIT.
+//  - dictionary,
+//    list:       the __PRELINK_INFO segment.
+//  - kext:       __PRELINK_INFO, and the executable of that kext.
+//  - kexts:      __PRELINK_INFO and __PRELINK_TEXT.
+//
+// aBuffer (aBufferSize bytes) must be zero filled. Returns the number of bytes
+// decoded, 0 on failure.
+
+size_t
+decodeProgressive (
+  unsigned char   *aBuffer,
+  size_t          aBufferSize,
+  unsigned char   *aSrc,
+  size_t          aSrcSize,
+  boolean_t       aKernel,
+  boolean_t       aPrelinkInfo,
+  boolean_t       aKexts,
+  const char      *aBundleID
+  )
+{
+  lzvn_decoder_state          state;
+  struct mach_header_64       *machHeader   = (struct mach_header_64 *)aBuffer;
+  struct mach_header_64       *kernelHeader = machHeader;
+  struct segment_command_64   *segment      = NULL;
+  uint64_t                    delta         = 0;
+  uint64_t                    offset        = 0;
+  uint64_t                    size          = 0;
+
+  lzvn_decoder_init (&state, aBuffer, 0);
+
+  state.src     = aSrc;
+  state.src_end = aSrc + aSrcSize;
+
+  if (!decodeUntil (&state, aBufferSize, sizeof (struct mach_header_64))
+    || (machHeader->magic != MH_MAGIC_64)
+    || !decodeUntil (&state, aBufferSize, sizeof (struct mach_header_64) + (uint64_t)machHeader->sizeofcmds)
+    )
+  {
+    return 0;
+  }
+
+  // The header of the kernel itself, which listKexts () and saveKernel () check.
+  if ((segment = find_segment_64 (machHeader, "__TEXT_EXEC")) != NULL)
+  {
+    delta         = segment->fileoff;
+    kernelHeader  = (struct mach_header_64 *)(aBuffer + delta);
+
+    if (!decodeUntil (&state, aBufferSize, delta + sizeof (struct mach_header_64))
+      || ((kernelHeader->magic == MH_MAGIC_64)
+        && !decodeUntil (&state, aBufferSize, delta + sizeof (struct mach_header_64) + (uint64_t)kernelHeader->sizeofcmds))
+      )
+    {
+      return 0;
+    }
+  }
+
+  if (aKernel)
+  {
+    if ((kernelHeader->magic != MH_MAGIC_64)
+      || ((segment = find_segment_64 (kernelHeader, "__LINKEDIT")) == NULL)
+      || !decodeUntil (&state, aBufferSize, delta + segment->fileoff + segment->filesize)
+      )
+    {
+      return 0;
+    }
+  }
+
+  if (aPrelinkInfo || aKexts || aBundleID)
+  {
+    if (((segment = find_segment_64 (machHeader, "__PRELINK_INFO")) == NULL)
+      || !decodeUntil (&state, aBufferSize, segment->fileoff + segment->filesize)
+      )
+    {
+      return 0;
+    }
+  }
+
+  if (aKexts)
+  {
+    if (((segment = find_segment_64 (machHeader, "__PRELINK_TEXT")) == NULL)
+      || !decodeUntil (&state, aBufferSize, segment->fileoff + segment->filesize)
+      )
+    {
+      return 0;
+    }
+  }
+  else if (aBundleID)
+  {
+    // Not found is reported by listKexts ().
+    if (findKextExecutable (aBuffer, aBundleID, &offset, &size)
+      && !decodeUntil (&state, aBufferSize, offset + size)
+      )
+    {
+      return 0;
+    }
+  }
+
+  return (size_t)(state.dst - aBuffer);
+}
+
+
+//==============================================================================
+// Creates aPath with aLength bytes and maps it shared, so the encoder/decoder
+// writes straight into the page cache. Finish with closeOutputFile().
+
+unsigned char *
+mapOutputFile (
+  const char  *aPath,
+  size_t      aLength,
+  int         *aFd
+  )
+{
+  unsigned char *buffer = NULL;
+  int           fd      = open (aPath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+  if (fd < 0)
+  {
+    printf ("ERROR: Open file %s\n", aPath);
+    return NULL;
+  }
+
+  if ((aLength == 0) || (ftruncate (fd, (off_t)aLength) != 0))
+  {
+    printf ("ERROR: Failed to size file %s\n", aPath);
+    close (fd);
+    unlink (aPath);
+    return NULL;
+  }
+
+  buffer = mmap (NULL, aLength, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+  if (buffer == MAP_FAILED)
+  {
+    printf ("ERROR: Failed to map file %s\n", aPath);
+    close (fd);
+    unlink (aPath);
+    return NULL;
+  }
+
+  *aFd = fd;
+
+  return buffer;
+}
+
+
+//==============================================================================
+// Unmaps an output mapping and trims the file to aLength bytes. A length of
+// zero means the data is unusable, and the file is removed.
+
+int
+closeOutputFile (
+  const char    *aPath,
+  unsigned char *aBuffer,
+  size_t        aMappedLength,
+  size_t        aLength,
+  int           aFd
+  )
+{
+  int ret = 0;
+
+  munmap (aBuffer, aMappedLength);
+
+  if ((aLength != 0) && (ftruncate (aFd, (off_t)aLength) != 0))
+  {
+    printf ("ERROR: Failed to size file %s\n", aPath);
+    ret = -1;
+  }
+
+  close (aFd);
+
+  if ((aLength == 0) || (ret != 0))
+  {
+    unlink (aPath);
+  }
+
+  return ret;
+}
+
+
+//==============================================================================
+
+#define STREAM_BUFFER_SIZE  (1 << 20)
+
+int
+compressStream (
+  FILE  *aInput,
+  FILE  *aOutput
+  )
+{
+  unsigned char         *inBuffer       = malloc (STREAM_BUFFER_SIZE);
+  unsigned char         *outBuffer      = malloc (STREAM_BUFFER_SIZE);
+  lzvn_encoder_stream   *stream         = lzvn_encoder_init ();
+  struct fat_header     *fatHeader      = (struct fat_header *)inBuffer;
+  struct fat_arch       *fatArch        = NULL;
+  struct mach_header_64 *machHeader     = NULL;
+
+  u_int32_t             adler32         = 1;
+  size_t                inSize          = 0;
+  size_t                inOffset        = 0;
+  size_t                inLeft          = SIZE_MAX;  // bytes of the FAT slice not read yet
+  size_t                available       = 0;
+  size_t                outSize         = 0;
+  size_t                used            = 0;
+  unsigned long         fileLength      = 0;
+  unsigned long         compressedSize  = 0;
+
+  int                   ret             = -1;
+
+  if ((inBuffer == NULL) || (outBuffer == NULL) || (stream == NULL))
+  {
+    printf ("ERROR: Failed to allocate stream buffers\n");
+    goto doneStream;
+  }
+
+  inSize = fread (inBuffer, 1, STREAM_BUFFER_SIZE, aInput);
+
+  // Check for a FAT header, and encode only the first slice (as without -stream).
+  if ((inSize >= (sizeof (struct fat_header) + sizeof (struct fat_arch))) && (fatHeader->magic == FAT_CIGAM))
+  {
+    fatArch   = (struct fat_arch *)(inBuffer + sizeof (struct fat_header));
+    inOffset  = OSSwapInt32 (fatArch->offset);
+    inLeft    = OSSwapInt32 (fatArch->size);
+  }
+
+  // The Mach-O header and load commands have to be in the first buffer.
+  available   = (inOffset < inSize) ? (inSize - inOffset) : 0;
+  available   = (available < inLeft) ? available : inLeft;
+  machHeader  = (struct mach_header_64 *)(inBuffer + inOffset);
+
+  if ((available < sizeof (struct mach_header_64))
+    || ((available - sizeof (struct mach_header_64)) < machHeader->sizeofcmds)
+    || !is_prelinkedkernel (inBuffer + inOffset)
+    )
+  {
+    printf ("ERROR: Unsupported format detected\n");
+    goto doneStream;
+  }
+
+  // Placeholder, fixed up once the sizes and adler32 are known.
+  if (fwrite (gFileHeader, sizeof (gFileHeader), 1, aOutput) != 1)
+  {
+    goto writeError;
+  }
+
+  while ((inSize > inOffset) && (inLeft > 0))
+  {
+    if ((inSize - inOffset) > inLeft)
+    {
+      inSize = inOffset + inLeft;
+    }
+
+    inLeft      -= (inSize - inOffset);
+    adler32     = local_adler32_update (adler32, inBuffer + inOffset, (int32_t)(inSize - inOffset));
+    fileLength  += (inSize - inOffset);
+
+    while (inOffset < inSize)
+    {
+      outSize = lzvn_encoder_feed (stream, outBuffer, STREAM_BUFFER_SIZE, inBuffer + inOffset, inSize - inOffset, &used);
+
+      if (fwrite (outBuffer, 1, outSize, aOutput) != outSize)
+      {
+        goto writeError;
+      }
+
+      compressedSize  += outSize;
+      inOffset        += used;
+    }
+
+    inOffset  = 0;
+    inSize    = fread (inBuffer, 1, STREAM_BUFFER_SIZE, aInput);
+  }
+
+  if ((fatArch != NULL) && (inLeft > 0))
+  {
+    printf ("ERROR: Invalid FAT header (slice exceeds the file)\n");
+    goto doneStream;
+  }
+
+  while ((outSize = lzvn_encoder_finish (stream, outBuffer, STREAM_BUFFER_SIZE)) > 0)
+  {
+    if (fwrite (outBuffer, 1, outSize, aOutput) != outSize)
+    {
+      goto writeError;
+    }
+
+    compressedSize += outSize;
+  }
+
+  printf ("fileLength...: %ld/0x%08lx\n", fileLength, fileLength);
+  printf ("adler32......: 0x%08x\n", adler32);
+  printf ("compressedSize.....: %ld/0x%08lx\n", compressedSize, compressedSize);
+
+  printf ("Fixing file header for prelinkedkernel ...\n");
+
+  gFileHeader[5]  = OSSwapInt32 (sizeof (gFileHeader) + compressedSize - 28);
+  gFileHeader[9]  = OSSwapInt32 (adler32);
+  gFileHeader[10] = OSSwapInt32 (fileLength);
+  gFileHeader[11] = OSSwapInt32 (compressedSize);
+
+  if ((fseek (aOutput, 0, SEEK_SET) != 0) || (fwrite (gFileHeader, sizeof (gFileHeader), 1, aOutput) != 1))
+  {
+    goto writeError;
+  }
+
+  ret = 0;
+  goto doneStream;
+
+writeError:
+
+  printf ("ERROR: Failed to write output file\n");
+
+doneStream:
+
+  lzvn_encoder_free (stream);
+  free (outBuffer);
+  free (inBuffer);
+
+  return ret;
+}
+
+
+//==============================================================================
+
+int
+decompressStream (
+  FILE  *aInput,
+  FILE  *aOutput
+  )
+{
+  unsigned char           *inBuffer       = malloc (STREAM_BUFFER_SIZE);
+  unsigned char           *window         = malloc (LZVN_DECODER_HISTORY + STREAM_BUFFER_SIZE);
+  unsigned char           *written        = window;
+  PrelinkedKernelHeader   *prelinkHeader  = NULL;
+  struct fat_header       *fatHeader      = (struct fat_header *)inBuffer;
+  struct fat_arch         *fatArch        = NULL;
+
+  lzvn_decoder_state      state;
+
+  u_int32_t               adler32         = 1;
+  u_int32_t               fileAdler32     = 0;
+  size_t                  inSize          = 0;
+  size_t                  inOffset        = 0;
+  size_t                  available       = 0;
+  size_t                  used            = 0;
+  unsigned long           compressedLeft  = 0;
+  unsigned long           fileLength      = 0;
+  unsigned long           uncompressedSize = 0;
+
+  int                     status          = 0;
+  int                     ret             = -1;
+
+  if ((inBuffer == NULL) || (window == NULL))
+  {
+    printf ("ERROR: Failed to allocate stream buffers\n");
+    goto doneStream;
+  }
+
+  inSize = fread (inBuffer, 1, STREAM_BUFFER_SIZE, aInput);
+
+  // Check for a FAT header.
+  if ((inSize >= (sizeof (struct fat_header) + sizeof (struct fat_arch))) && (fatHeader->magic == FAT_CIGAM))
+  {
+    unsigned int i = 0;
+
+    fatArch = (struct fat_arch *)(inBuffer + sizeof (struct fat_header));
+
+    while ((i < OSSwapInt32 (fatHeader->nfat_arch))
+      && ((unsigned char *)(fatArch + 1) <= (inBuffer + inSize))
+      )
+    {
+      inOffset = OSSwapInt32 (fatArch->offset);
+
+      if (((inOffset + sizeof (PrelinkedKernelHeader)) <= inSize)
+        && (((PrelinkedKernelHeader *)(inBuffer + inOffset))->signature == OSSwapInt32 ('comp'))
+        )
+      {
+        break;
+      }
+
+      fatArch++;
+      ++i;
+    }
+  }
+
+  prelinkHeader = (PrelinkedKernelHeader *)(inBuffer + inOffset);
+
+  if (((inOffset + sizeof (PrelinkedKernelHeader)) > inSize)
+    || (prelinkHeader->signature != OSSwapInt32 ('comp'))
+    || (prelinkHeader->compressType != OSSwapInt32 ('lzvn'))
+    )
+  {
+    printf ("ERROR: Unsupported format detected (streaming decode supports LZVN only)\n");
+    goto doneStream;
+  }
+
+  fileAdler32       = OSSwapInt32 (prelinkHeader->adler32);
+  uncompressedSize  = OSSwapInt32 (prelinkHeader->uncompressedSize);
+  compressedLeft    = OSSwapInt32 (prelinkHeader->compressedSize);
+  inOffset          += sizeof (PrelinkedKernelHeader);
+
+  lzvn_decoder_init (&state, window, LZVN_DECODER_HISTORY + STREAM_BUFFER_SIZE);
+
+  for ( ; ; )
+  {
+    available = ((inSize - inOffset) < compressedLeft) ? (inSize - inOffset) : compressedLeft;
+
+    state.src     = inBuffer + inOffset;
+    state.src_end = state.src + available;
+
+    status = lzvn_decoder_run (&state);
+
+    used            = state.src - (inBuffer + inOffset);
+    inOffset        += used;
+    compressedLeft  -= used;
+
+    // Write (and checksum) the new output while it is still in cache.
+    adler32     = local_adler32_update (adler32, written, (int32_t)(state.dst - written));
+
+    if (fwrite (written, 1, state.dst - written, aOutput) != (size_t)(state.dst - written))
+    {
+      printf ("ERROR: Failed to write output file\n");
+      goto doneStream;
+    }
+
+    fileLength  += (state.dst - written);
+    written     = state.dst;
+
+    if (status != 0)
+    {
+      break;
+    }
+
+    if (state.dst == state.dst_end)
+    {
+      lzvn_decoder_slide (&state);
+      written = state.dst;
+      continue;
+    }
+
+    // Out of input. Keep the unused bytes (partial opcode) and read more.
+    memmove (inBuffer, inBuffer + inOffset, inSize - inOffset);
+    inSize    -= inOffset;
+    inOffset  = 0;
+    used      = (compressedLeft > inSize) ? fread (inBuffer + inSize, 1, STREAM_BUFFER_SIZE - inSize, aInput) : 0;
+
+    if (used == 0)
+    {
+      break;
+    }
+
+    inSize += used;
+  }
+
+  printf ("%ld bytes written\n", fileLength);
+
+  if ((status != 1) || (fileLength != uncompressedSize))
+  {
+    printf ("ERROR: Decoding failed\n");
+    goto doneStream;
+  }
+
+  printf ("Checking adler32 ... ");
+
+  if (adler32 != fileAdler32)
+  {
+    printf ("ERROR: Adler32 mismatch\n");
+    goto doneStream;
+  }
+
+  printf ("OK (0x%08x)\n", adler32);
+
+  ret = 0;
+
+doneStream:
+
+  free (window);
+  free (inBuffer);
+
+  return ret;
+}
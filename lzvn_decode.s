@@ -1,8 +1,8 @@
 .text
 
-.globl _lzvn_decode
+.globl _lzvn_decode_asm
 
-_lzvn_decode:
+_lzvn_decode_asm:
 	pushq	%rbp
 	movq	%rsp, %rbp
 	pushq	%rbx
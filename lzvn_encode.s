@@ -1,9 +1,9 @@
 .text
 
-.globl _lzvn_encode
+.globl _lzvn_encode_asm
 .globl _lzvn_encode_work_size
 
-_lzvn_encode:
+_lzvn_encode_asm:
 	pushq	%rbp
 	movq	%rsp, %rbp
 	pushq	%rbx
@@ -31,7 +31,7 @@ _lzvn_encode_partial:
 	pushq	%r13
 	pushq	%r12
 	pushq	%rbx
-	subq	$0xc8, %rsp
+	subq	$0xd8, %rsp
 	movq	%r9, -0xc0(%rbp)
 	movq	%r8, -0xe8(%rbp)
 	movq	%rdx, %r12
@@ -43,6 +43,21 @@ _lzvn_encode_partial:
 	cmpq	$0x8, %rcx
 	movl	$0x0, %ebx
 	jb		Lzvn_8092c
+	leaq	-0x1(%rcx), %rax
+	bsrq	%rax, %rax
+	addl	$-0x3, %eax
+	movl	$0xa, %r10d
+	cmpl	%r10d, %eax
+	cmovll	%r10d, %eax
+	movl	$0xe, %r10d
+	cmpl	%r10d, %eax
+	cmovgl	%r10d, %eax
+	xorl	%r10d, %r10d
+	btsl	%eax, %r10d
+	leal	-0x1(%r10), %eax
+	movq	%rax, -0xf0(%rbp)
+	shlq	$0x5, %r10
+	movq	%r10, -0xf8(%rbp)
 	movl	$0xffffffff, %eax
 	addq	$-0x8, %rsi
 	movl	(%r12), %r10d
@@ -55,7 +70,7 @@ Lzvn_7fa2a:
 	movdqa	%xmm1, (%r9,%rdx)
 	movdqa	%xmm0, 0x10(%r9,%rdx)
 	addq	$0x20, %rdx
-	cmpq	$0x80000, %rdx
+	cmpq	-0xf8(%rbp), %rdx
 	jne		Lzvn_7fa2a
 	cmpq	%rax, %rcx
 	cmovaq	%rax, %rcx
@@ -110,7 +125,7 @@ Lzvn_7faed:
 	andl	$0xffffff, %eax
 	imull	$0x1041, %eax, %eax
 	shrl	$0xc, %eax
-	andl	$0x3fff, %eax
+	andl	-0xf0(%rbp), %eax
 	shlq	$0x5, %rax
 	movdqa	(%r9,%rax), %xmm0
 	movdqa	0x10(%r9,%rax), %xmm1
@@ -1277,7 +1292,7 @@ Lzvn_8092c:
 	movq	-0xe8(%rbp), %rax
 	movq	%rdx, (%rax)
 	movq	%rbx, %rax
-	addq	$0xc8, %rsp
+	addq	$0xd8, %rsp
 	popq	%rbx
 	popq	%r12
 	popq	%r13